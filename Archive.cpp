@@ -0,0 +1,112 @@
+#include "Archive.hpp"
+
+#include "compress.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+
+Archive::Archive(std::string const &filename) : file(filename) {
+	if (file.size < sizeof(Header)) {
+		throw std::runtime_error("Archive '" + filename + "' is too small to have a header.");
+	}
+	Header header;
+	std::memcpy(&header, file.data, sizeof(Header));
+	if (std::string(header.magic, 4) != "pak0") {
+		throw std::runtime_error("Archive '" + filename + "' has the wrong magic number.");
+	}
+	if (header.entries_offset % alignof(Entry) != 0
+	 || header.entries_offset > file.size
+	 || (file.size - header.entries_offset) / sizeof(Entry) < header.count
+	 || header.names_offset > file.size
+	 || file.size - header.names_offset < header.names_size) {
+		throw std::runtime_error("Archive '" + filename + "' has an index that doesn't fit in the file.");
+	}
+
+	entries = reinterpret_cast< Entry const * >(file.data + header.entries_offset);
+	count = header.count;
+	names = file.data + header.names_offset;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		Entry const &entry = entries[i];
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= header.names_size)
+		 || entry.offset > file.size || file.size - entry.offset < entry.stored_size
+		 || entry.offset % PayloadAlignment != 0
+		 || (entry.codec == CodecNone && entry.size != entry.stored_size)
+		 || (entry.codec != CodecNone && entry.codec != CodecLZ)
+		 || (i > 0 && entries[i-1].hash > entry.hash)) {
+			throw std::runtime_error("Archive '" + filename + "' has an invalid entry (" + std::to_string(i) + ").");
+		}
+	}
+}
+
+Archive::Entry const *Archive::find(std::string const &name) const {
+	uint64_t h = hash(name.data(), name.data() + name.size());
+	Entry const *end = entries + count;
+	for (Entry const *e = std::lower_bound(entries, end, h, [](Entry const &entry, uint64_t h) { return entry.hash < h; });
+		e != end && e->hash == h; ++e) {
+		if (std::string(names + e->name_begin, names + e->name_end) == name) return e;
+	}
+	return nullptr;
+}
+
+void Archive::contents(Entry const &entry, char const **data, size_t *size, std::vector< char > *storage) const {
+	char const *stored = file.data + entry.offset;
+	if (entry.codec == CodecNone) {
+		*data = stored;
+		*size = size_t(entry.stored_size);
+		return;
+	}
+	//unpack into storage (vector memory is suitably aligned for chunk data):
+	storage->resize(size_t(entry.size));
+	if (!decompress(stored, size_t(entry.stored_size), storage->data(), storage->size())) {
+		throw std::runtime_error("Archive '" + file.filename + "' has a corrupt entry '" + std::string(names + entry.name_begin, names + entry.name_end) + "'.");
+	}
+	*data = storage->data();
+	*size = storage->size();
+}
+
+//the data archive (or nullptr if there isn't a usable one):
+static Archive const *get_data_archive() {
+	//(function-static, so the archive is opened once, on first use, from whichever thread gets here first)
+	static std::unique_ptr< Archive > archive = []() -> std::unique_ptr< Archive > {
+		std::string filename = data_path("data.pack");
+		try {
+			return std::unique_ptr< Archive >(new Archive(filename));
+		} catch (std::exception &e) {
+			//no (usable) archive, so all data comes from loose files:
+			std::ifstream test(filename, std::ios::binary);
+			if (test) std::cerr << "WARNING: ignoring data archive: " << e.what() << std::endl;
+			return nullptr;
+		}
+	}();
+	return archive.get();
+}
+
+//look up a path (under data_path()) in the data archive:
+static Archive::Entry const *find_data_archive_entry(Archive const *archive, std::string const &path) {
+	if (!archive) return nullptr;
+
+	//archive names are relative to the data directory:
+	static std::string const prefix = data_path("");
+	if (path.compare(0, prefix.size(), prefix) != 0) return nullptr;
+	return archive->find(path.substr(prefix.size()));
+}
+
+bool find_in_data_archive(std::string const &path, char const **data, size_t *size, std::vector< char > *storage) {
+	Archive const *archive = get_data_archive();
+	Archive::Entry const *entry = find_data_archive_entry(archive, path);
+	if (!entry) return false;
+
+	archive->contents(*entry, data, size, storage);
+	return true;
+}
+
+bool data_file_exists(std::string const &path) {
+	if (find_data_archive_entry(get_data_archive(), path)) return true;
+	std::ifstream test(path, std::ios::binary);
+	return bool(test);
+}
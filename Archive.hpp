@@ -0,0 +1,78 @@
+#pragma once
+
+#include "MappedFile.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+//An Archive packs many data files into one file (built by the 'pack' tool from the 'dist' directory):
+//
+//  Header
+//  payloads (each starting at a multiple of PayloadAlignment, so they can be used straight from a mapping)
+//  Entry[count] (sorted by name hash)
+//  names (not null-terminated; entries refer to them by [begin,end) offsets)
+//
+// payloads are either stored as-is or compressed with the codec in compress.hpp.
+
+struct Archive {
+	struct Header {
+		char magic[4] = {'p','a','k','0'};
+		uint32_t count = 0; //number of entries
+		uint64_t entries_offset = 0;
+		uint64_t names_offset = 0;
+		uint64_t names_size = 0;
+	};
+	static_assert(sizeof(Header) == 32, "Header is packed.");
+
+	enum Codec : uint32_t {
+		CodecNone = 0,
+		CodecLZ = 1,
+	};
+
+	struct Entry {
+		uint64_t hash = 0; //hash(name)
+		uint64_t offset = 0; //payload position in archive
+		uint64_t stored_size = 0; //payload size in archive
+		uint64_t size = 0; //size after decompression
+		uint32_t name_begin = 0, name_end = 0;
+		uint32_t codec = CodecNone;
+		uint32_t padding = 0;
+	};
+	static_assert(sizeof(Entry) == 48, "Entry is packed.");
+
+	enum : uint64_t { PayloadAlignment = 16 };
+
+	//FNV-1a (64-bit) hash of entry names:
+	static uint64_t hash(char const *begin, char const *end) {
+		uint64_t h = 14695981039346656037ull;
+		for (char const *c = begin; c != end; ++c) {
+			h = (h ^ uint8_t(*c)) * 1099511628211ull;
+		}
+		return h;
+	}
+
+	//map an archive and check its index; throws on failure:
+	Archive(std::string const &filename);
+
+	//look up an entry by name (e.g., "textures/wood.png"); returns nullptr if not present:
+	Entry const *find(std::string const &name) const;
+
+	//get an entry's contents: stored entries point straight into the archive; compressed entries are unpacked into 'storage':
+	void contents(Entry const &entry, char const **data, size_t *size, std::vector< char > *storage) const;
+
+	//internals:
+	MappedFile file;
+	Entry const *entries = nullptr;
+	uint32_t count = 0;
+	char const *names = nullptr;
+};
+
+//The data archive is "data.pack" next to the executable (if it exists).
+//If 'path' (which was presumably built using data_path()) is in the data archive, point 'data' + 'size' at its contents and return true:
+// (compressed entries are unpacked into 'storage')
+bool find_in_data_archive(std::string const &path, char const **data, size_t *size, std::vector< char > *storage);
+
+//is 'path' in the data archive or on disk?
+bool data_file_exists(std::string const &path);
@@ -0,0 +1,40 @@
+#include "ChunkFile.hpp"
+
+#include "Archive.hpp"
+
+#include <cstring>
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_) {
+	char const *data = nullptr;
+	size_t size = 0;
+	if (!find_in_data_archive(filename, &data, &size, &unpacked)) {
+		file.reset(new MappedFile(filename));
+		data = file->data;
+		size = file->size;
+	}
+
+	//check chunk headers:
+	size_t at = 0;
+	while (at < size) {
+		if (size - at < 8) {
+			throw std::runtime_error("Truncated chunk header in '" + filename + "'");
+		}
+		Chunk chunk;
+		std::memcpy(chunk.magic, data + at, 4);
+		std::memcpy(&chunk.size, data + at + 4, 4);
+		at += 8;
+		if (chunk.size > size - at) {
+			throw std::runtime_error("Chunk '" + std::string(chunk.magic, 4) + "' in '" + filename + "' runs past end of file");
+		}
+		chunk.data = data + at;
+		at += chunk.size;
+		chunks.emplace_back(chunk);
+	}
+}
+
+char const *ChunkFile::aligned(Chunk const &chunk, size_t alignment) {
+	if (reinterpret_cast< uintptr_t >(chunk.data) % alignment == 0) return chunk.data;
+	//chunks follow each other with no padding, so may land at odd addresses; copy (heap allocations are suitably aligned):
+	copies.emplace_back(chunk.data, chunk.data + chunk.size);
+	return copies.back().data();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "MappedFile.hpp"
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+//ChunkFile memory-maps a file made of read_chunk-style chunks (4-byte magic, 4-byte size, data)
+// and hands out typed views of the chunk data without copying it.
+// (files in the data archive -- see Archive.hpp -- are read from there instead)
+//   ChunkFile file(data_path("meshes.pnct"));
+//   auto verts = file.read< Vertex >("pnct");
+//   glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex), verts.data(), GL_STATIC_DRAW);
+// spans stay valid as long as the ChunkFile does.
+struct ChunkFile {
+	//maps the file and checks that its chunk headers are sane; throws on failure:
+	ChunkFile(std::string const &filename);
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+
+	template< typename T >
+	struct Span {
+		T const *begin_ = nullptr;
+		T const *end_ = nullptr;
+
+		Span() = default;
+		Span(T const *begin__, T const *end__) : begin_(begin__), end_(end__) { }
+
+		T const *begin() const { return begin_; }
+		T const *end() const { return end_; }
+		T const *data() const { return begin_; }
+		size_t size() const { return end_ - begin_; }
+		bool empty() const { return begin_ == end_; }
+		T const &operator[](size_t i) const { return begin_[i]; }
+	};
+
+	//return the next chunk's data as an array of T; throws if the magic doesn't match or size isn't a multiple of sizeof(T):
+	template< typename T >
+	Span< T > read(std::string const &magic);
+
+	//have all chunks been read?
+	bool at_end() const { return next == chunks.size(); }
+
+	//is the next chunk's magic 'magic'? (for optional chunks)
+	bool next_is(std::string const &magic) const { return next < chunks.size() && std::string(chunks[next].magic, 4) == magic; }
+
+	std::string filename;
+
+	//internals:
+	struct Chunk {
+		char magic[4];
+		uint32_t size;
+		char const *data;
+	};
+	std::vector< Chunk > chunks;
+	size_t next = 0; //index of next chunk to read
+
+	std::unique_ptr< MappedFile > file; //file contents (if not in the data archive)
+	std::vector< char > unpacked; //file contents (if compressed in the data archive)
+	std::list< std::vector< char > > copies; //copies of chunks whose data wasn't aligned for their type
+
+	char const *aligned(Chunk const &chunk, size_t alignment);
+};
+
+template< typename T >
+ChunkFile::Span< T > ChunkFile::read(std::string const &magic) {
+	if (next >= chunks.size()) {
+		throw std::runtime_error("Failed to read chunk header in '" + filename + "'");
+	}
+	Chunk const &chunk = chunks[next];
+	next += 1;
+
+	if (std::string(chunk.magic, 4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk of '" + filename + "' (expected '" + magic + "', got '" + std::string(chunk.magic, 4) + "')");
+	}
+	if (chunk.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk '" + magic + "' in '" + filename + "' not divisible by element size");
+	}
+
+	T const *begin = reinterpret_cast< T const * >(aligned(chunk, alignof(T)));
+	return Span< T >(begin, begin + chunk.size / sizeof(T));
+}
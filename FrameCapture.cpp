@@ -0,0 +1,134 @@
+#include "FrameCapture.hpp"
+
+#include "load_save_png.hpp"
+#include "gl_errors.hpp"
+
+#include <iostream>
+#include <cassert>
+
+FrameCapture::FrameCapture() {
+	for (auto &readback : ring) {
+		glGenBuffers(1, &readback.buffer);
+	}
+
+	worker = std::thread([this](){
+		while (true) {
+			Job job;
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				cv.wait(lock, [this](){ return quit || !jobs.empty(); });
+				if (jobs.empty()) return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+				busy += 1;
+			}
+			cv.notify_all(); //(capture() may be waiting for room)
+
+			//the default framebuffer's alpha isn't meaningful, so make the image opaque:
+			for (auto &px : job.pixels) {
+				px.a = 0xff;
+			}
+			try {
+				save_png(job.filename, job.size, job.pixels.data(), LowerLeftOrigin);
+			} catch (std::exception &e) {
+				std::cerr << "WARNING: failed to save capture '" << job.filename << "': " << e.what() << std::endl;
+			}
+
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				busy -= 1;
+			}
+			cv.notify_all(); //(finish() may be waiting)
+		}
+	});
+}
+
+FrameCapture::~FrameCapture() {
+	finish();
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	cv.notify_all();
+	worker.join();
+
+	for (auto &readback : ring) {
+		glDeleteBuffers(1, &readback.buffer);
+		readback.buffer = 0;
+	}
+}
+
+void FrameCapture::capture(glm::uvec2 const &size, std::string const &filename) {
+	//if every readback is in flight, the oldest has to finish first:
+	if (count == RingSize) {
+		retire(ring[first], true);
+		first = (first + 1) % RingSize;
+		count -= 1;
+	}
+	Readback &readback = ring[(first + count) % RingSize];
+	count += 1;
+	assert(readback.fence == 0);
+
+	readback.size = size;
+	readback.filename = filename;
+
+	//read into the buffer object (so glReadPixels returns right away):
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, size.x * size.y * 4, NULL, GL_STREAM_READ);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	GL_ERRORS();
+}
+
+void FrameCapture::update() {
+	while (count > 0 && retire(ring[first], false)) {
+		first = (first + 1) % RingSize;
+		count -= 1;
+	}
+}
+
+void FrameCapture::finish() {
+	while (count > 0) {
+		retire(ring[first], true);
+		first = (first + 1) % RingSize;
+		count -= 1;
+	}
+	std::unique_lock< std::mutex > lock(mutex);
+	cv.wait(lock, [this](){ return jobs.empty() && busy == 0; });
+}
+
+bool FrameCapture::retire(Readback &readback, bool wait) {
+	assert(readback.fence != 0);
+	if (wait) {
+		while (glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull /* 1s */) == GL_TIMEOUT_EXPIRED) {
+			//keep waiting
+		}
+	} else {
+		if (glClientWaitSync(readback.fence, 0, 0) == GL_TIMEOUT_EXPIRED) return false;
+	}
+	glDeleteSync(readback.fence);
+	readback.fence = 0;
+
+	Job job;
+	job.size = readback.size;
+	job.filename = readback.filename;
+	job.pixels.resize(job.size.x * job.size.y);
+	//(the readback is finished, so this is just a copy)
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, job.pixels.size() * 4, job.pixels.data());
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	GL_ERRORS();
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		//don't let encoding fall arbitrarily far behind:
+		cv.wait(lock, [this](){ return jobs.size() < MaxQueued; });
+		jobs.emplace_back(std::move(job));
+	}
+	cv.notify_all();
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//FrameCapture saves the contents of the default framebuffer to PNG files without stalling the render loop:
+// capture() starts a glReadPixels into a pixel buffer object; update() (called once per frame) collects
+// readbacks the GPU has finished -- usually a frame or two later -- and hands them to a worker thread that
+// encodes them with save_png().
+//
+//  FrameCapture capture;
+//  //...each frame, after drawing and before swapping:
+//  if (want_screenshot) capture.capture(drawable_size, "screenshot.png");
+//  capture.update();
+//
+//NOTE: create, use, and destroy on the main (GL) thread, while the context exists.
+struct FrameCapture {
+	FrameCapture();
+	~FrameCapture(); //finishes all pending captures
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+
+	//start reading back the lower-left 'size' pixels of the back buffer, to be saved as 'filename':
+	// (waits only if all RingSize readbacks are still in flight or too many images are waiting to be encoded)
+	void capture(glm::uvec2 const &size, std::string const &filename);
+
+	//hand finished readbacks to the worker:
+	void update();
+
+	//wait for every capture to be written:
+	void finish();
+
+	//internals:
+	enum : uint32_t {
+		RingSize = 3, //readbacks in flight
+		MaxQueued = 8, //images waiting for the encoder
+	};
+
+	struct Readback {
+		GLuint buffer = 0; //pixel pack buffer
+		GLsync fence = 0; //(0 if not in use)
+		glm::uvec2 size = glm::uvec2(0);
+		std::string filename;
+	};
+	Readback ring[RingSize];
+	uint32_t first = 0; //oldest in-flight readback
+	uint32_t count = 0; //number of in-flight readbacks
+
+	//hand a readback to the worker (waiting for the GPU if 'wait' is true); returns false if not ready:
+	bool retire(Readback &readback, bool wait);
+
+	struct Job {
+		glm::uvec2 size;
+		std::vector< glm::u8vec4 > pixels;
+		std::string filename;
+	};
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque< Job > jobs;
+	uint32_t busy = 0; //jobs being encoded right now
+	bool quit = false;
+	std::thread worker;
+};
@@ -11,10 +11,13 @@
 #include "compile_program.hpp" //helper to compile opengl shader programs
 #include "draw_text.hpp" //helper to... um.. draw text
 #include "load_save_png.hpp"
+#include "TextureFile.hpp" //textures prepared by the texconv tool
+#include "Archive.hpp" //for data_file_exists
 #include "texture_program.hpp"
 #include "tesseract_program.hpp"
 #include "depth_program.hpp"
 #include "mesh4d.hpp"
+#include "jobs.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -25,6 +28,7 @@
 #include <cstddef>
 #include <cstdlib>
 #include <random>
+#include <memory>
 
 MLoad< Mesh4D > hypercube(LoadTagDefault, [](){
 	glm::vec4 hypercube_vertices_[] = {
@@ -124,17 +128,21 @@ MLoad <Mesh4D> reference_hypercube(LoadTagDefault, [](){
 	return new Mesh4D(*hypercube);
 });
 
-Load< MeshBuffer > meshes(LoadTagDefault, [](){
-	return new MeshBuffer(data_path("vignette.pnct"));
+Load< MeshBuffer > meshes(LoadTagDefault, LoadInBackground, [](){
+	MeshBuffer *ret = new MeshBuffer(data_path("vignette.pnct"), MeshBuffer::DeferUpload);
+	return [ret](){
+		ret->upload();
+		return ret;
+	};
 });
 
 Load< GLuint > meshes_for_texture_program(LoadTagDefault, [](){
 	return new GLuint(meshes->make_vao_for_program(texture_program->program));
-});
+}, {&meshes});
 
 Load< GLuint > meshes_for_depth_program(LoadTagDefault, [](){
 	return new GLuint(meshes->make_vao_for_program(depth_program->program));
-});
+}, {&meshes});
 
 //used for fullscreen passes:
 Load< GLuint > empty_vao(LoadTagDefault, [](){
@@ -145,8 +153,8 @@ Load< GLuint > empty_vao(LoadTagDefault, [](){
 	return new GLuint(vao);
 });
 
-Load< GLuint > blur_program(LoadTagDefault, [](){
-	GLuint program = compile_program(
+Load< GLuint > blur_program(LoadTagDefault, LoadFinishLater, [](){
+	auto pending = std::make_shared< PendingProgram >(start_compile_program(
 		//this draws a triangle that covers the entire screen:
 		"#version 330\n"
 		"void main() {\n"
@@ -181,27 +189,33 @@ Load< GLuint > blur_program(LoadTagDefault, [](){
 		"	;\n"
 		"	fragColor = vec4(blur.rgb, 1.0);\n" //blur;\n"
 		"}\n"
-	);
+	));
 
-	glUseProgram(program);
+	return [pending](){
+		GLuint program = finish_compile_program(*pending);
 
-	glUniform1i(glGetUniformLocation(program, "tex"), 0);
+		glUseProgram(program);
 
-	glUseProgram(0);
+		glUniform1i(glGetUniformLocation(program, "tex"), 0);
+
+		glUseProgram(0);
 
-	return new GLuint(program);
+		return new GLuint(program);
+	};
 });
 
 
-GLuint load_texture(std::string const &filename) {
+//textures are loaded in two parts -- decoding the image (on any thread) and uploading it (on the GL thread):
+struct Image {
 	glm::uvec2 size;
 	std::vector< glm::u8vec4 > data;
-	load_png(filename, &size, &data, LowerLeftOrigin);
+};
 
+GLuint upload_texture(Image const &image) {
 	GLuint tex = 0;
 	glGenTextures(1, &tex);
 	glBindTexture(GL_TEXTURE_2D, tex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.size.x, image.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data.data());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -213,12 +227,30 @@ GLuint load_texture(std::string const &filename) {
 	return tex;
 }
 
-Load< GLuint > wood_tex(LoadTagDefault, [](){
-	return new GLuint(load_texture(data_path("textures/wood.png")));
+//decode on the calling thread; returns the function that uploads the texture:
+// (if 'texconv' has made a .tex version of the file, that is used instead -- it needs no decoding or mipmap generation)
+std::function< GLuint const *() > load_texture_in_background(std::string const &filename) {
+	std::string tex_filename = filename.substr(0, filename.rfind('.')) + ".tex";
+	if (data_file_exists(tex_filename)) {
+		std::shared_ptr< TextureFile > texture = std::make_shared< TextureFile >(tex_filename);
+		return [texture](){
+			return new GLuint(texture->upload());
+		};
+	}
+
+	std::shared_ptr< Image > image = std::make_shared< Image >();
+	load_png(filename, &image->size, &image->data, LowerLeftOrigin);
+	return [image](){
+		return new GLuint(upload_texture(*image));
+	};
+}
+
+Load< GLuint > wood_tex(LoadTagDefault, LoadInBackground, [](){
+	return load_texture_in_background(data_path("textures/wood.png"));
 });
 
-Load< GLuint > marble_tex(LoadTagDefault, [](){
-	return new GLuint(load_texture(data_path("textures/marble.png")));
+Load< GLuint > marble_tex(LoadTagDefault, LoadInBackground, [](){
+	return load_texture_in_background(data_path("textures/marble.png"));
 });
 
 Load< GLuint > white_tex(LoadTagDefault, [](){
@@ -244,21 +276,21 @@ Scene::Camera *camera = nullptr;
 Scene::Transform *spot_parent_transform = nullptr;
 Scene::Lamp *spot = nullptr;
 
-Load< Scene > scene(LoadTagDefault, [](){
+//the scene is built on a worker thread once the meshes, vaos, and textures it refers to are ready:
+MLoad< Scene > scene(LoadTagDefault, LoadInBackground, [](){
 	Scene *ret = new Scene;
 
 	//pre-build some program info (material) blocks to assign to each object:
 	Scene::Object::ProgramInfo texture_program_info;
 	texture_program_info.program = texture_program->program;
 	texture_program_info.vao = *meshes_for_texture_program;
-	texture_program_info.mvp_mat4  = texture_program->object_to_clip_mat4;
-	texture_program_info.mv_mat4x3 = texture_program->object_to_light_mat4x3;
-	texture_program_info.itmv_mat3 = texture_program->normal_to_light_mat3;
+	texture_program_info.object_base_int = texture_program->object_base_int;
 
 	Scene::Object::ProgramInfo depth_program_info;
 	depth_program_info.program = depth_program->program;
 	depth_program_info.vao = *meshes_for_depth_program;
-	depth_program_info.mvp_mat4  = depth_program->object_to_clip_mat4;
+	depth_program_info.object_base_int = depth_program->object_base_int;
+	depth_program_info.object_data_normals = false;
 
 
 	//load transform hierarchy:
@@ -282,53 +314,34 @@ Load< Scene > scene(LoadTagDefault, [](){
 
 		obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
 		obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
-	});
-
-	//look up camera parent transform:
-	for (Scene::Transform *t = ret->first_transform; t != nullptr; t = t->alloc_next) {
-		if (t->name == "CameraParent") {
-			if (camera_parent_transform) throw std::runtime_error("Multiple 'CameraParent' transforms in scene.");
-			camera_parent_transform = t;
-		}
-		if (t->name == "SpotParent") {
-			if (spot_parent_transform) throw std::runtime_error("Multiple 'SpotParent' transforms in scene.");
-			spot_parent_transform = t;
-		}
-		if(t->name == "WinText") {
-			if (win_text_transform) throw std::runtime_error("Multiple 'WinText' transforms in scene.");
-			win_text_transform = t;
-		}
 
-		if(t->name == "LoseText") {
-			if (lose_text_transform) throw std::runtime_error("Multiple 'LoseText' transforms in scene.");
-			lose_text_transform = t;
-		}
+		obj->bbox_min = mesh.min;
+		obj->bbox_max = mesh.max;
+	});
 
-	}
+	//look up named transforms:
+	camera_parent_transform = ret->lookup_transform("CameraParent");
 	if (!camera_parent_transform) throw std::runtime_error("No 'CameraParent' transform in scene.");
+	spot_parent_transform = ret->lookup_transform("SpotParent");
 	if (!spot_parent_transform) throw std::runtime_error("No 'SpotParent' transform in scene.");
+	win_text_transform = ret->lookup_transform("WinText");
+	lose_text_transform = ret->lookup_transform("LoseText");
 
 	//look up the camera:
-	for (Scene::Camera *c = ret->first_camera; c != nullptr; c = c->alloc_next) {
-		if (c->transform->name == "Camera") {
-			if (camera) throw std::runtime_error("Multiple 'Camera' objects in scene.");
-			camera = c;
-		}
-	}
+	camera = ret->lookup_camera("Camera");
 	if (!camera) throw std::runtime_error("No 'Camera' camera in scene.");
 
 	//look up the spotlight:
-	for (Scene::Lamp *l = ret->first_lamp; l != nullptr; l = l->alloc_next) {
-		if (l->transform->name == "Spot") {
-			if (spot) throw std::runtime_error("Multiple 'Spot' objects in scene.");
-			if (l->type != Scene::Lamp::Spot) throw std::runtime_error("Lamp 'Spot' is not a spotlight.");
-			spot = l;
-		}
-	}
+	spot = ret->lookup_lamp("Spot");
 	if (!spot) throw std::runtime_error("No 'Spot' spotlight in scene.");
+	if (spot->type != Scene::Lamp::Spot) throw std::runtime_error("Lamp 'Spot' is not a spotlight.");
 
-	return ret;
-});
+	ret->update_bvh();
+
+	return [ret](){
+		return ret;
+	};
+}, {&meshes, &meshes_for_texture_program, &meshes_for_depth_program, &wood_tex, &marble_tex, &white_tex});
 
 GameMode::GameMode() {
 	hypercube->apply_perspective();
@@ -351,6 +364,10 @@ GameMode::GameMode() {
 
 	win_text_transform->position.z = -5;
 	lose_text_transform->position.z = -5;
+
+	//menu text (see draw_text.hpp) loads on first use; startup loads are done by now, so start reading it
+	// in the background, well before the pause menu could first be drawn:
+	prefetch_loads("text");
 }
 
 GameMode::~GameMode() {
@@ -391,7 +408,10 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 	}
 
 	if (evt.type == SDL_KEYDOWN) {
-		if (evt.key.keysym.sym == SDLK_SPACE) {
+		if (evt.key.keysym.sym == SDLK_ESCAPE) {
+			show_pause_menu();
+			return true;
+		} else if (evt.key.keysym.sym == SDLK_SPACE) {
 			// check
 			if(display_timer <= 0) {
 				float d = glm::dot(hypercube->reference, reference_hypercube->reference);
@@ -432,6 +452,25 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 	return false;
 }
 
+void GameMode::show_pause_menu() {
+	std::shared_ptr< Mode > game = shared_from_this();
+	std::shared_ptr< MenuMode > menu = std::make_shared< MenuMode >();
+
+	menu->choices.emplace_back("PAUSED");
+	menu->choices.emplace_back("RESUME", [game](){
+		Mode::set_current(game);
+	});
+	menu->choices.emplace_back("QUIT", [](){
+		Mode::set_current(nullptr);
+	});
+
+	menu->selected = 1;
+	menu->background = game;
+	menu->background_time_scale = 0.0f;
+
+	Mode::set_current(menu);
+}
+
 void GameMode::update(float elapsed) {
 	camera_parent_transform->rotation = glm::angleAxis(camera_spin, glm::vec3(0.0f, 0.0f, 1.0f));
 	spot_parent_transform->rotation = glm::angleAxis(spot_spin, glm::vec3(0.0f, 0.0f, 1.0f));
@@ -530,6 +569,9 @@ void GameMode::update(float elapsed) {
 
 	if(display_timer > 0)
 		display_timer -= elapsed;
+
+	//transforms have moved, so refit culling structure:
+	scene->update_bvh();
 }
 
 //GameMode will render to some offscreen framebuffer(s).
@@ -615,6 +657,18 @@ struct Framebuffers {
 void GameMode::draw(glm::uvec2 const &drawable_size) {
 	fbs.allocate(drawable_size, glm::uvec2(512, 512));
 
+	camera->aspect = drawable_size.x / float(drawable_size.y);
+
+	//Figure out what to draw in both passes at once (one pass per chunk, so the shadow pass can run on a worker thread):
+	glm::mat4 spot_world_to_clip = spot->make_projection() * spot->transform->make_world_to_local();
+	glm::mat4 camera_world_to_clip = camera->make_projection() * camera->transform->make_world_to_local();
+	parallel_chunks(2, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t pass = begin; pass < end; ++pass) {
+			if (pass == 0) scene->prepare(camera_world_to_clip, Scene::Object::ProgramTypeDefault, &camera_draw_list);
+			else scene->prepare(spot_world_to_clip, Scene::Object::ProgramTypeShadow, &shadow_draw_list);
+		}
+	});
+
 	//Draw scene to shadow map for spotlight:
 	glBindFramebuffer(GL_FRAMEBUFFER, fbs.shadow_fb);
 	glViewport(0,0,fbs.shadow_size.x, fbs.shadow_size.y);
@@ -628,7 +682,7 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 	glCullFace(GL_FRONT);
 	glEnable(GL_CULL_FACE);
 
-	scene->draw(spot, Scene::Object::ProgramTypeShadow);
+	scene->submit(shadow_draw_list);
 
 	glDisable(GL_CULL_FACE);
 
@@ -642,8 +696,6 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 	glBindFramebuffer(GL_FRAMEBUFFER, fbs.fb);
 	glViewport(0,0,drawable_size.x, drawable_size.y);
 
-	camera->aspect = drawable_size.x / float(drawable_size.y);
-
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -672,7 +724,7 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 			0.5f, 0.5f, 0.5f+0.00001f /* <-- bias */, 1.0f
 		)
 		//this is the world-to-clip matrix used when rendering the shadow map:
-		* spot->make_projection() * spot->transform->make_world_to_local();
+		* spot_world_to_clip;
 
 	glUniformMatrix4fv(texture_program->light_to_spot_mat4, 1, GL_FALSE, glm::value_ptr(world_to_spot));
 
@@ -694,7 +746,7 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 	//NOTE: however, these are parameters of the texture object, not the binding point, so there is no need to set them *each frame*. I'm doing it here so that you are likely to see that they are being set.
 	glActiveTexture(GL_TEXTURE0);
 
-	scene->draw(camera);
+	scene->submit(camera_draw_list);
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, 0);
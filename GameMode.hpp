@@ -54,4 +54,11 @@ struct GameMode : public Mode {
 
 	void regenerate_target_rotations();
 	void reapply_target_rotations();
+
+	//pause menu (escape), drawn over the game:
+	void show_pause_menu();
+
+	//draw lists for the shadow and camera passes (kept around to reuse their storage):
+	Scene::DrawList shadow_draw_list;
+	Scene::DrawList camera_draw_list;
 };
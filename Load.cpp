@@ -1,28 +1,268 @@
 #include "Load.hpp"
 
+#include "startup_timing.hpp"
+#include "jobs.hpp"
+
 #include <array>
 #include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <future>
+#include <chrono>
+#include <algorithm>
 #include <cassert>
 
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
 namespace {
-	std::array< std::list< std::function< void() > >, LoadTagCount > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, LoadTagCount > load_lists;
+	struct LoadFunction {
+		std::function< void() > fn; //main-thread only load
+		std::function< std::function< void() >() > background_fn; //(or) split load
+		std::function< std::function< void() >() > start_fn; //(or) main-thread load that finishes at the end of the tag
+		void const *key = nullptr;
+		std::vector< void const * > after;
+		std::string name;
+
+		//status while loading:
+		bool started = false;
+		std::future< std::function< void() > > finish;
+		std::function< void() > finish_later; //(from start_fn)
+		float background_ms = 0.0f;
+		float main_ms = 0.0f;
+	};
+
+	std::array< std::list< LoadFunction >, LoadTagCount > &get_load_lists() {
+		static std::array< std::list< LoadFunction >, LoadTagCount > load_lists;
 		return load_lists;
 	}
+
+	std::vector< LoadTiming > &get_timings() {
+		static std::vector< LoadTiming > timings;
+		return timings;
+	}
+
+	float ms_since(std::chrono::high_resolution_clock::time_point const &before) {
+		return std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+	}
+}
+
+std::string make_load_name(std::type_info const &type, char const *file, int line) {
+	std::string type_name = type.name();
+	#if defined(__GNUC__)
+	int status = 0;
+	char *demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+	if (demangled) {
+		if (status == 0) type_name = demangled;
+		std::free(demangled);
+	}
+	#endif
+
+	std::string name = "Load< " + type_name + " >";
+	if (file && file[0] != '\0') {
+		std::string path = file;
+		size_t slash = path.find_last_of("/\\");
+		if (slash != std::string::npos) path = path.substr(slash + 1);
+		name = path + ":" + std::to_string(line) + " " + name;
+	}
+	return name;
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key, std::vector< void const * > const &after, std::string const &name) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	load_lists[tag].emplace_back();
+	LoadFunction &load = load_lists[tag].back();
+	load.fn = fn;
+	load.key = key;
+	load.after = after;
+	load.name = name;
+}
+
+void add_background_load_function(LoadTag tag, std::function< std::function< void() >() > const &background_fn, void const *key, std::vector< void const * > const &after, std::string const &name) {
+	auto &load_lists = get_load_lists();
+	assert(tag < load_lists.size());
+	load_lists[tag].emplace_back();
+	LoadFunction &load = load_lists[tag].back();
+	load.background_fn = background_fn;
+	load.key = key;
+	load.after = after;
+	load.name = name;
+}
+
+void add_finish_later_load_function(LoadTag tag, std::function< std::function< void() >() > const &start_fn, void const *key, std::vector< void const * > const &after, std::string const &name) {
+	auto &load_lists = get_load_lists();
+	assert(tag < load_lists.size());
+	load_lists[tag].emplace_back();
+	LoadFunction &load = load_lists[tag].back();
+	load.start_fn = start_fn;
+	load.key = key;
+	load.after = after;
+	load.name = name;
 }
 
 void call_load_functions() {
 	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	auto &timings = get_timings();
+
+	//which tag each (keyed) load is in, to check dependencies:
+	std::unordered_map< void const *, uint32_t > key_tags;
+	for (uint32_t tag = 0; tag < load_lists.size(); ++tag) {
+		for (auto const &load : load_lists[tag]) {
+			if (load.key) key_tags.emplace(load.key, tag);
 		}
 	}
+
+	std::unordered_set< void const * > done; //keys of finished loads
+
+	for (uint32_t tag = 0; tag < load_lists.size(); ++tag) {
+		auto &fn_list = load_lists[tag];
+
+		for (auto const &load : fn_list) {
+			for (void const *key : load.after) {
+				auto f = key_tags.find(key);
+				if (f == key_tags.end()) {
+					throw std::runtime_error("Load '" + load.name + "' lists a dependency that isn't a load.");
+				}
+				if (f->second > tag) {
+					throw std::runtime_error("Load '" + load.name + "' depends on a load in a later tag.");
+				}
+			}
+		}
+
+		//order loads so that dependencies come first (otherwise keeping the order they were added in):
+		std::vector< LoadFunction * > order;
+		order.reserve(fn_list.size());
+		{
+			std::unordered_set< LoadFunction * > placed;
+			std::unordered_set< void const * > placed_keys;
+			while (order.size() < fn_list.size()) {
+				bool progress = false;
+				for (auto &load : fn_list) {
+					if (placed.count(&load)) continue;
+					bool ready = true;
+					for (void const *key : load.after) {
+						if (key_tags[key] == tag && !placed_keys.count(key)) ready = false;
+					}
+					if (ready) {
+						order.emplace_back(&load);
+						placed.insert(&load);
+						if (load.key) placed_keys.insert(load.key);
+						progress = true;
+						break;
+					}
+				}
+				if (!progress) {
+					throw std::runtime_error("Loads in tag " + std::to_string(tag) + " have circular dependencies.");
+				}
+			}
+		}
+
+		//start background parts of any loads whose dependencies are finished:
+		auto start_ready = [&](){
+			for (LoadFunction *load : order) {
+				if (!load->background_fn || load->started) continue;
+				bool ready = true;
+				for (void const *key : load->after) {
+					if (!done.count(key)) ready = false;
+				}
+				if (!ready) continue;
+				load->started = true;
+				auto task = std::make_shared< std::packaged_task< std::function< void() >() > >([load](){
+					auto before = std::chrono::high_resolution_clock::now();
+					std::function< void() > finish = load->background_fn();
+					load->background_ms = ms_since(before);
+					return finish;
+				});
+				load->finish = task->get_future();
+				run_job([task](){ (*task)(); });
+			}
+		};
+		start_ready();
+
+		auto mark_done = [&](LoadFunction *load) {
+			timings.emplace_back(LoadTiming{load->name, LoadTag(tag), load->background_ms, load->main_ms});
+			std::string name = (load->name.empty() ? "(unnamed)" : load->name);
+			record_startup_time("load " + name, timings.back().main_ms);
+			if (load->background_fn) record_startup_time("load " + name + " [worker]", timings.back().background_ms);
+			if (load->key) done.insert(load->key);
+			start_ready();
+		};
+
+		//LoadFinishLater loads that have started, but not finished:
+		std::vector< LoadFunction * > unfinished;
+		auto finish_later = [&](LoadFunction *load) {
+			auto before = std::chrono::high_resolution_clock::now();
+			load->finish_later();
+			load->main_ms += ms_since(before);
+			mark_done(load);
+		};
+
+		//run main-thread parts in order:
+		for (LoadFunction *load : order) {
+			//anything this load depends on needs to actually be finished:
+			for (auto u = unfinished.begin(); u != unfinished.end(); /* later */) {
+				if (std::find(load->after.begin(), load->after.end(), (*u)->key) != load->after.end()) {
+					finish_later(*u);
+					u = unfinished.erase(u);
+				} else {
+					++u;
+				}
+			}
+
+			auto before = std::chrono::high_resolution_clock::now();
+			if (load->background_fn) {
+				assert(load->started); //dependencies are earlier in 'order', so are done
+				std::function< void() > finish = load->finish.get(); //(rethrows exceptions from the worker)
+				before = std::chrono::high_resolution_clock::now();
+				finish();
+			} else if (load->start_fn) {
+				load->finish_later = load->start_fn();
+				load->main_ms = ms_since(before);
+				unfinished.emplace_back(load);
+				continue;
+			} else {
+				load->fn();
+			}
+			load->main_ms = ms_since(before);
+			mark_done(load);
+		}
+
+		//finish everything that was started (in order, so that results match the order loads were added):
+		for (LoadFunction *load : unfinished) {
+			finish_later(load);
+		}
+
+		fn_list.clear();
+	}
+}
+
+namespace {
+	std::unordered_map< std::string, std::vector< std::function< void() > > > &get_lazy_groups() {
+		static std::unordered_map< std::string, std::vector< std::function< void() > > > groups;
+		return groups;
+	}
+}
+
+void add_lazy_load(std::string const &group, std::function< void() > const &prefetch_fn) {
+	get_lazy_groups()[group].emplace_back(prefetch_fn);
+}
+
+void prefetch_loads(std::string const &group) {
+	auto &groups = get_lazy_groups();
+	auto f = groups.find(group);
+	if (f == groups.end()) return;
+	for (auto const &prefetch_fn : f->second) {
+		prefetch_fn();
+	}
+}
+
+void record_lazy_load_time(std::string const &name, float ms) {
+	record_startup_time("lazy load " + name, ms);
+}
+
+std::vector< LoadTiming > const &get_load_timings() {
+	return get_timings();
 }
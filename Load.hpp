@@ -21,10 +21,48 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. "Meshes"] before looking up individual elements within them.)
  *
+ * Loads that spend time on the CPU (reading files, decoding images, parsing) can do that work on a worker thread
+ * by passing 'LoadInBackground' and a function that returns the part to run on the main thread (OpenGL calls):
+ *
+ * Load< GLuint > wood_tex(LoadTagDefault, LoadInBackground, [](){
+ *     auto image = std::make_shared< Image >(data_path("wood.png")); //worker thread: no OpenGL here!
+ *     return [image]() { return new GLuint(upload(*image)); }; //main thread
+ * });
+ *
+ * Main-thread parts within a tag run in the order they were added, but all background parts in a tag
+ * start right away. A load may also list other loads it needs (in the same or earlier tags);
+ * it will not start until they are finished:
+ *
+ * Load< GLuint > vao(LoadTagDefault, [](){ ... *meshes ... }, {&meshes});
+ *
+ * Main-thread work that the driver can do in parallel (e.g., compiling shaders) can be split with 'LoadFinishLater':
+ * the first function starts the work and returns a function that finishes it, which is called once
+ * every other load in the tag has started (or sooner, if another load lists it in 'after'):
+ *
+ * Load< GLuint > program(LoadTagInit, LoadFinishLater, [](){
+ *     auto pending = std::make_shared< PendingProgram >(start_compile_program(...));
+ *     return [pending]() { return new GLuint(finish_compile_program(*pending)); };
+ * });
+ *
+ * Things that aren't needed right away can use a LazyLoad< T > instead, which loads when first dereferenced.
+ * Split LazyLoads belong to a named group, and prefetch_loads("group") starts their background parts early
+ * (e.g., just before switching to the mode that uses them):
+ *
+ * LazyLoad< MeshBuffer > menu_meshes("menu", LoadInBackground, [](){ ... });
+ * LazyLoad< GLuint > menu_program([](){ ... }); //(main-thread-only; nothing to prefetch, so no group)
+ *
  */
 
+#include "jobs.hpp"
+
 #include <functional>
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include <typeinfo>
+#include <future>
+#include <memory>
+#include <chrono>
 
 enum LoadTag : uint32_t {
 	LoadTagInit = 0, //used for loading mesh and texture blobs before main
@@ -33,19 +71,98 @@ enum LoadTag : uint32_t {
 	LoadTagCount = 3
 };
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+//'key' identifies the load (Load<> uses its own address) so that other loads can list it in 'after':
+void add_load_function(LoadTag tag, std::function< void() > const &fn,
+	void const *key = nullptr, std::vector< void const * > const &after = {}, std::string const &name = "");
+
+//background_fn runs on a worker thread and returns a function to call on the main thread:
+void add_background_load_function(LoadTag tag, std::function< std::function< void() >() > const &background_fn,
+	void const *key = nullptr, std::vector< void const * > const &after = {}, std::string const &name = "");
+
+//start_fn runs on the main thread and returns a function to call (also on the main thread) at the end of the tag:
+void add_finish_later_load_function(LoadTag tag, std::function< std::function< void() >() > const &start_fn,
+	void const *key = nullptr, std::vector< void const * > const &after = {}, std::string const &name = "");
+
 void call_load_functions(); //called by main() after GL context created.
 
+//time taken by each load function, available after call_load_functions():
+struct LoadTiming {
+	std::string name;
+	LoadTag tag;
+	float background_ms; //time spent on a worker thread
+	float main_ms; //time spent on the main thread
+};
+std::vector< LoadTiming > const &get_load_timings();
+
+//Load<> names itself after the file and line it was declared on (where the compiler can tell us) and its type:
+#if defined(__has_builtin)
+	#if __has_builtin(__builtin_FILE) && __has_builtin(__builtin_LINE)
+		#define LOAD_CALLER_FILE __builtin_FILE()
+		#define LOAD_CALLER_LINE __builtin_LINE()
+	#endif
+#elif defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+	#define LOAD_CALLER_FILE __builtin_FILE()
+	#define LOAD_CALLER_LINE __builtin_LINE()
+#endif
+#ifndef LOAD_CALLER_FILE
+	#define LOAD_CALLER_FILE ""
+	#define LOAD_CALLER_LINE 0
+#endif
+std::string make_load_name(std::type_info const &type, char const *file, int line);
+
+//marker for Load<> constructors that take a background function:
+struct LoadInBackgroundT { };
+constexpr LoadInBackgroundT LoadInBackground = LoadInBackgroundT();
+
+//marker for Load<> constructors that take a start function that returns a finish function:
+struct LoadFinishLaterT { };
+constexpr LoadFinishLaterT LoadFinishLater = LoadFinishLaterT();
+
+//LazyLoad<>s register a function to start their background part with their group:
+void add_lazy_load(std::string const &group, std::function< void() > const &prefetch_fn);
+
+//start the background parts of all not-yet-loaded LazyLoad<>s in a group:
+void prefetch_loads(std::string const &group);
+
+//lazy loads report their time to the startup report, if they happen then:
+void record_lazy_load_time(std::string const &name, float ms);
+
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< T const *() > &load_fn ) : value(nullptr) {
+	Load( LoadTag tag, const std::function< T const *() > &load_fn, std::vector< void const * > const &after = {}, char const *file = LOAD_CALLER_FILE, int line = LOAD_CALLER_LINE ) : value(nullptr) {
 		add_load_function(tag, [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		}, this, after, make_load_name(typeid(T), file, line));
+	}
+
+	//Split load: background_fn runs on a worker thread and returns the function that finishes loading on the main thread:
+	Load( LoadTag tag, LoadInBackgroundT, const std::function< std::function< T const *() >() > &background_fn, std::vector< void const * > const &after = {}, char const *file = LOAD_CALLER_FILE, int line = LOAD_CALLER_LINE ) : value(nullptr) {
+		add_background_load_function(tag, [this,background_fn](){
+			std::function< T const *() > finish_fn = background_fn();
+			return std::function< void() >([this,finish_fn](){
+				this->value = finish_fn();
+				if (!(this->value)) {
+					throw std::runtime_error("Loading failed.");
+				}
+			});
+		}, this, after, make_load_name(typeid(T), file, line));
+	}
+
+	//Deferred load: start_fn runs on the main thread and returns the function that finishes loading (see above):
+	Load( LoadTag tag, LoadFinishLaterT, const std::function< std::function< T const *() >() > &start_fn, std::vector< void const * > const &after = {}, char const *file = LOAD_CALLER_FILE, int line = LOAD_CALLER_LINE ) : value(nullptr) {
+		add_finish_later_load_function(tag, [this,start_fn](){
+			std::function< T const *() > finish_fn = start_fn();
+			return std::function< void() >([this,finish_fn](){
+				this->value = finish_fn();
+				if (!(this->value)) {
+					throw std::runtime_error("Loading failed.");
+				}
+			});
+		}, this, after, make_load_name(typeid(T), file, line));
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
@@ -62,13 +179,26 @@ struct Load {
 template< typename T >
 struct MLoad {
 	//Constructing a MLoad< T > adds the passed function to the list of functions to call:
-	MLoad( LoadTag tag, const std::function< T *() > &load_fn ) : value(nullptr) {
+	MLoad( LoadTag tag, const std::function< T *() > &load_fn, std::vector< void const * > const &after = {}, char const *file = LOAD_CALLER_FILE, int line = LOAD_CALLER_LINE ) : value(nullptr) {
 		add_load_function(tag, [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		}, this, after, make_load_name(typeid(T), file, line));
+	}
+
+	//Split load (see Load< T >):
+	MLoad( LoadTag tag, LoadInBackgroundT, const std::function< std::function< T *() >() > &background_fn, std::vector< void const * > const &after = {}, char const *file = LOAD_CALLER_FILE, int line = LOAD_CALLER_LINE ) : value(nullptr) {
+		add_background_load_function(tag, [this,background_fn](){
+			std::function< T *() > finish_fn = background_fn();
+			return std::function< void() >([this,finish_fn](){
+				this->value = finish_fn();
+				if (!(this->value)) {
+					throw std::runtime_error("Loading failed.");
+				}
+			});
+		}, this, after, make_load_name(typeid(T), file, line));
 	}
 
 	//Make a "MLoad< T >" behave like a "T *":
@@ -78,3 +208,55 @@ struct MLoad {
 
 	T *value;
 };
+
+// Version of Load<> that loads the first time it is used (rather than at startup).
+// NOTE: dereference only from the main (GL) thread.
+template< typename T >
+struct LazyLoad {
+	//Main-thread-only load (nothing to prefetch, so it isn't in a group):
+	LazyLoad( const std::function< T const *() > &load_fn_, char const *file = LOAD_CALLER_FILE, int line = LOAD_CALLER_LINE )
+		: load_fn(load_fn_), name(make_load_name(typeid(T), file, line)) {
+	}
+
+	//Split load (see Load< T >); the background part can be started early by prefetch():
+	LazyLoad( std::string const &group, LoadInBackgroundT, const std::function< std::function< T const *() >() > &background_fn_, char const *file = LOAD_CALLER_FILE, int line = LOAD_CALLER_LINE )
+		: background_fn(background_fn_), name(make_load_name(typeid(T), file, line)) {
+		add_lazy_load(group, [this](){ prefetch(); });
+	}
+
+	//start the background part of the load on a worker thread (if there is one and it hasn't started):
+	void prefetch() {
+		if (value || prefetched.valid() || !background_fn) return;
+		auto task = std::make_shared< std::packaged_task< std::function< T const *() >() > >(background_fn);
+		prefetched = task->get_future();
+		run_job([task](){ (*task)(); });
+	}
+
+	//Make a "LazyLoad< T >" behave like a "T const *" (loading if needed):
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
+
+	T const *get() {
+		if (!value) {
+			auto before = std::chrono::high_resolution_clock::now();
+			if (background_fn) {
+				std::function< T const *() > finish_fn = (prefetched.valid() ? prefetched.get() : background_fn());
+				value = finish_fn();
+			} else {
+				value = load_fn();
+			}
+			if (!value) {
+				throw std::runtime_error("Loading failed.");
+			}
+			record_lazy_load_time(name, std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count());
+		}
+		return value;
+	}
+
+	T const *value = nullptr;
+
+	std::function< T const *() > load_fn;
+	std::function< std::function< T const *() >() > background_fn;
+	std::future< std::function< T const *() > > prefetched;
+	std::string name;
+};
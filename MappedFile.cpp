@@ -0,0 +1,70 @@
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename_) : filename(filename_) {
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER file_size;
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+			HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping != NULL) {
+				mapped = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				if (mapped) mapped_size = size_t(file_size.QuadPart);
+				CloseHandle(mapping); //(the view keeps the mapping alive)
+			}
+		}
+		CloseHandle(file);
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd != -1) {
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *addr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr != MAP_FAILED) {
+				mapped = reinterpret_cast< char const * >(addr);
+				mapped_size = size_t(st.st_size);
+			}
+		}
+		close(fd);
+	}
+	#endif
+
+	if (mapped) {
+		data = mapped;
+		size = mapped_size;
+	} else {
+		//couldn't map (or the file is empty), so just read it:
+		std::ifstream file(filename, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Failed to open '" + filename + "'");
+		}
+		contents.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+		data = contents.data();
+		size = contents.size();
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (mapped) {
+		#if defined(_WIN32)
+		UnmapViewOfFile(mapped);
+		#else
+		munmap(const_cast< char * >(mapped), mapped_size);
+		#endif
+		mapped = nullptr;
+	}
+}
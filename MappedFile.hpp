@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//MappedFile maps a whole file into memory (read-only),
+// falling back to reading it into a buffer when mapping isn't possible.
+struct MappedFile {
+	//throws if the file can't be opened:
+	MappedFile(std::string const &filename);
+	~MappedFile();
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	std::string filename;
+
+	//file contents:
+	char const *data = nullptr;
+	size_t size = 0;
+
+	//internals:
+	char const *mapped = nullptr; //(if mapped)
+	size_t mapped_size = 0;
+	std::vector< char > contents; //(if mapping wasn't possible)
+};
@@ -12,7 +12,8 @@
 
 GLint fade_program_color = -1;
 
-Load< GLuint > fade_program(LoadTagInit, [](){
+//(menu resources load on first use)
+LazyLoad< GLuint > fade_program([](){
 	GLuint *ret = new GLuint(compile_program(
 		"#version 330\n"
 		"void main() {\n"
@@ -33,7 +34,7 @@ Load< GLuint > fade_program(LoadTagInit, [](){
 });
 
 //vao that binds nothing:
-Load< GLuint > empty_binding(LoadTagDefault, [](){
+LazyLoad< GLuint > empty_binding([](){
 	GLuint vao;
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
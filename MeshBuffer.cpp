@@ -1,22 +1,43 @@
 #include "MeshBuffer.hpp"
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "startup_timing.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
 #include <cstddef>
+#include <cassert>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
+MeshBuffer::MeshBuffer(std::string const &filename) : MeshBuffer(filename, DeferUpload) {
+	upload();
+}
+
+MeshBuffer::~MeshBuffer() {
+}
+
+void MeshBuffer::upload() {
+	assert(vbo == 0 && "MeshBuffer should only be uploaded once.");
+	StartupTimer timer("MeshBuffer upload " + pending_file->filename.substr(pending_file->filename.find_last_of("/\\") + 1));
 	glGenBuffers(1, &vbo);
 
-	std::ifstream file(filename, std::ios::binary);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, pending_size, pending_data, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	pending_data = nullptr;
+	pending_size = 0;
+	pending_file.reset();
+}
+
+MeshBuffer::MeshBuffer(std::string const &filename, DeferUploadT) : pending_file(new ChunkFile(filename)) {
+	ChunkFile &file = *pending_file;
 
 	GLuint total = 0;
+	std::vector< glm::vec3 > positions; //kept around to compute mesh bounds
 	//read + upload data chunk:
 	if (filename.size() >= 2 && filename.substr(filename.size()-2) == ".p") {
 		struct Vertex {
@@ -24,16 +45,19 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "p...", &data);
+		auto data = file.read< Vertex >("p...");
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//data will be uploaded straight from the file mapping:
+		pending_data = data.data();
+		pending_size = data.size() * sizeof(Vertex);
 
 		total = GLuint(data.size()); //store total for later checks on index
 
+		positions.reserve(data.size());
+		for (auto const &v : data) {
+			positions.emplace_back(v.Position);
+		}
+
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 
@@ -44,16 +68,19 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pn..", &data);
+		auto data = file.read< Vertex >("pn..");
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//data will be uploaded straight from the file mapping:
+		pending_data = data.data();
+		pending_size = data.size() * sizeof(Vertex);
 
 		total = GLuint(data.size()); //store total for later checks on index
 
+		positions.reserve(data.size());
+		for (auto const &v : data) {
+			positions.emplace_back(v.Position);
+		}
+
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
@@ -66,16 +93,19 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4+4*1, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pnc.", &data);
+		auto data = file.read< Vertex >("pnc.");
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//data will be uploaded straight from the file mapping:
+		pending_data = data.data();
+		pending_size = data.size() * sizeof(Vertex);
 
 		total = GLuint(data.size()); //store total for later checks on index
 
+		positions.reserve(data.size());
+		for (auto const &v : data) {
+			positions.emplace_back(v.Position);
+		}
+
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
@@ -90,16 +120,19 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pnct", &data);
+		auto data = file.read< Vertex >("pnct");
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//data will be uploaded straight from the file mapping:
+		pending_data = data.data();
+		pending_size = data.size() * sizeof(Vertex);
 
 		total = GLuint(data.size()); //store total for later checks on index
 
+		positions.reserve(data.size());
+		for (auto const &v : data) {
+			positions.emplace_back(v.Position);
+		}
+
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
@@ -110,8 +143,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	auto strings = file.read< char >("str0");
 
 	{ //read index chunk, add to meshes:
 		struct IndexEntry {
@@ -120,8 +152,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		auto index = file.read< IndexEntry >("idx0");
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -130,10 +161,17 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			std::string name(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
 			Mesh mesh;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
+			if (mesh.count) {
+				mesh.min = mesh.max = positions[mesh.start];
+				for (uint32_t v = mesh.start + 1; v < mesh.start + mesh.count; ++v) {
+					mesh.min = glm::min(mesh.min, positions[v]);
+					mesh.max = glm::max(mesh.max, positions[v]);
+				}
+			}
 			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
 			if (!inserted) {
 				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
@@ -141,7 +179,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		}
 	}
 
-	if (file.peek() != EOF) {
+	if (!file.at_end()) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
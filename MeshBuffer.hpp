@@ -1,7 +1,13 @@
 #pragma once
 
 #include "GL.hpp"
+
+#include <glm/glm.hpp>
+
 #include <map>
+#include <memory>
+
+struct ChunkFile;
 
 //"MeshBuffer" holds a collection of meshes loaded from a file
 // (note that meshes in a single collection will share a vbo/vao)
@@ -33,11 +39,22 @@ struct MeshBuffer {
 	// note: will throw if file fails to read.
 	MeshBuffer(std::string const &filename);
 
+	//two-step construction, for loading on a worker thread:
+	// the constructor reads the file without making any OpenGL calls, and upload() creates the vbo (on the GL thread).
+	enum DeferUploadT { DeferUpload };
+	MeshBuffer(std::string const &filename, DeferUploadT);
+	void upload();
+
+	~MeshBuffer();
+
 	//look up a particular mesh in the DB:
 	// note: will throw if mesh not found.
 	struct Mesh {
 		GLuint start = 0;
 		GLuint count = 0;
+		//bounding box of the mesh's vertex positions:
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
 	};
 	const Mesh &lookup(std::string const &name) const;
 	
@@ -48,4 +65,9 @@ struct MeshBuffer {
 
 	//internals:
 	std::map< std::string, Mesh > meshes;
+
+	//vertex data waiting for upload():
+	std::unique_ptr< ChunkFile > pending_file;
+	void const *pending_data = nullptr;
+	size_t pending_size = 0;
 };
@@ -1,11 +1,16 @@
 #include "Scene.hpp"
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "gl_errors.hpp"
+#include "jobs.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <SDL.h>
+
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <cmath>
 
 glm::mat4 Scene::Transform::make_local_to_parent() const {
 	return glm::mat4( //translate
@@ -51,6 +56,17 @@ glm::mat4 Scene::Transform::make_local_to_world() const {
 	}
 }
 
+bool Scene::Transform::world_cache_current() const {
+	for (Transform const *t = this; t != nullptr; t = t->parent) {
+		if (!t->cached
+		 || t->position != t->cached_position
+		 || t->rotation != t->cached_rotation
+		 || t->scale != t->cached_scale
+		 || t->parent != t->cached_parent) return false;
+	}
+	return true;
+}
+
 glm::mat4 Scene::Transform::make_world_to_local() const {
 	if (parent) {
 		return make_parent_to_local() * parent->make_world_to_local();
@@ -141,41 +157,118 @@ void list_delete(T * t) {
 	t->alloc_prev_next = nullptr;
 }
 
+//helpers to maintain name indices:
+template< typename T >
+void index_erase(std::unordered_multimap< Scene::Name, T *, Scene::NameHash > &index, Scene::Name const &name, T *t) {
+	auto range = index.equal_range(name);
+	for (auto i = range.first; i != range.second; ++i) {
+		if (i->second == t) {
+			index.erase(i);
+			return;
+		}
+	}
+}
+
+template< typename T >
+T *index_lookup(std::unordered_multimap< Scene::Name, T *, Scene::NameHash > const &index, std::string const &name, std::string const &what) {
+	auto range = index.equal_range(Scene::Name(name));
+	if (range.first == range.second) return nullptr;
+	auto next = range.first;
+	++next;
+	if (next != range.second) {
+		throw std::runtime_error("Multiple '" + name + "' " + what + " in scene.");
+	}
+	return range.first->second;
+}
+
 Scene::Transform *Scene::new_transform() {
 	return list_new< Scene::Transform >(first_transform);
 }
 
 void Scene::delete_transform(Scene::Transform *transform) {
+	index_erase(transform_index, transform->name, transform);
 	list_delete< Scene::Transform >(transform);
 }
 
 Scene::Object *Scene::new_object(Scene::Transform *transform) {
 	assert(transform && "Scene::Object must be attached to a transform.");
+	bvh.dirty = true;
 	return list_new< Scene::Object >(first_object, transform);
 }
 
 void Scene::delete_object(Scene::Object *object) {
+	bvh.dirty = true;
 	list_delete< Scene::Object >(object);
 }
 
 Scene::Lamp *Scene::new_lamp(Scene::Transform *transform) {
 	assert(transform && "Scene::Lamp must be attached to a transform.");
-	return list_new< Scene::Lamp >(first_lamp, transform);
+	Scene::Lamp *lamp = list_new< Scene::Lamp >(first_lamp, transform);
+	if (transform->name.size()) lamp_index.emplace(transform->name, lamp);
+	return lamp;
 }
 
 void Scene::delete_lamp(Scene::Lamp *object) {
+	index_erase(lamp_index, object->transform->name, object);
 	list_delete< Scene::Lamp >(object);
 }
 
 Scene::Camera *Scene::new_camera(Scene::Transform *transform) {
 	assert(transform && "Scene::Camera must be attached to a transform.");
-	return list_new< Scene::Camera >(first_camera, transform);
+	Scene::Camera *camera = list_new< Scene::Camera >(first_camera, transform);
+	if (transform->name.size()) camera_index.emplace(transform->name, camera);
+	return camera;
 }
 
 void Scene::delete_camera(Scene::Camera *object) {
+	index_erase(camera_index, object->transform->name, object);
 	list_delete< Scene::Camera >(object);
 }
 
+void Scene::set_name(Scene::Transform *transform, std::string const &name) {
+	assert(transform && "Can only name a transform that exists.");
+
+	//remove the old name from the indices:
+	index_erase(transform_index, transform->name, transform);
+	for (Camera *camera = first_camera; camera != nullptr; camera = camera->alloc_next) {
+		if (camera->transform == transform) index_erase(camera_index, transform->name, camera);
+	}
+	for (Lamp *lamp = first_lamp; lamp != nullptr; lamp = lamp->alloc_next) {
+		if (lamp->transform == transform) index_erase(lamp_index, transform->name, lamp);
+	}
+
+	if (name.empty()) {
+		transform->name = Name();
+		return;
+	}
+
+	//copy the name into a table owned by the scene:
+	name_tables.emplace_back(name.begin(), name.end());
+	std::vector< char > &table = name_tables.back();
+	transform->name = Name(table.data(), table.data() + table.size());
+
+	//...and add it to the indices (same rules as load()):
+	transform_index.emplace(transform->name, transform);
+	for (Camera *camera = first_camera; camera != nullptr; camera = camera->alloc_next) {
+		if (camera->transform == transform) camera_index.emplace(transform->name, camera);
+	}
+	for (Lamp *lamp = first_lamp; lamp != nullptr; lamp = lamp->alloc_next) {
+		if (lamp->transform == transform) lamp_index.emplace(transform->name, lamp);
+	}
+}
+
+Scene::Transform *Scene::lookup_transform(std::string const &name) const {
+	return index_lookup(transform_index, name, "transforms");
+}
+
+Scene::Camera *Scene::lookup_camera(std::string const &name) const {
+	return index_lookup(camera_index, name, "cameras");
+}
+
+Scene::Lamp *Scene::lookup_lamp(std::string const &name) const {
+	return index_lookup(lamp_index, name, "lamps");
+}
+
 void Scene::draw(Scene::Camera const *camera, Object::ProgramType program_type) const {
 	assert(camera && "Must have a camera to draw scene from.");
 	assert(program_type < Object::ProgramTypes);
@@ -197,36 +290,254 @@ void Scene::draw(Scene::Lamp const *lamp, Object::ProgramType program_type) cons
 }
 
 
+namespace {
+	//inverse transpose of m, skipping the inverse when m is a rotation times a uniform scale:
+	glm::mat3 make_normal_matrix(glm::mat3 const &m) {
+		float s2 = glm::dot(m[0], m[0]);
+		float eps = 1e-5f * s2;
+		if (s2 > 0.0f
+		 && std::abs(glm::dot(m[1], m[1]) - s2) <= eps && std::abs(glm::dot(m[2], m[2]) - s2) <= eps
+		 && std::abs(glm::dot(m[0], m[1])) <= eps && std::abs(glm::dot(m[0], m[2])) <= eps && std::abs(glm::dot(m[1], m[2])) <= eps) {
+			//m = s R, so inverse(transpose(m)) = (1/s) R = m / s^2:
+			return m * (1.0f / s2);
+		}
+		return glm::inverse(glm::transpose(m));
+	}
+}
+
+std::string Scene::object_data_glsl() {
+	std::string stride = std::to_string(uint32_t(ObjectDataStride));
+	return std::string(draw_id_supported()
+		? "#extension GL_ARB_shader_draw_parameters : require\n"
+		  "#define DRAW_ID gl_DrawIDARB\n"
+		: "#define DRAW_ID 0\n")
+		+ "uniform samplerBuffer object_data;\n"
+		"uniform int object_base;\n"
+		"mat4 object_to_clip_data() {\n"
+		"	int i = " + stride + " * (object_base + DRAW_ID);\n"
+		"	return mat4(texelFetch(object_data, i+0), texelFetch(object_data, i+1), texelFetch(object_data, i+2), texelFetch(object_data, i+3));\n"
+		"}\n"
+		"mat4x3 object_to_light_data() {\n"
+		"	int i = " + stride + " * (object_base + DRAW_ID) + 4;\n"
+		"	return mat4x3(texelFetch(object_data, i+0).xyz, texelFetch(object_data, i+1).xyz, texelFetch(object_data, i+2).xyz, texelFetch(object_data, i+3).xyz);\n"
+		"}\n"
+		"mat3 normal_to_light_data() {\n"
+		"	int i = " + stride + " * (object_base + DRAW_ID) + 8;\n"
+		"	return mat3(texelFetch(object_data, i+0).xyz, texelFetch(object_data, i+1).xyz, texelFetch(object_data, i+2).xyz);\n"
+		"}\n"
+	;
+}
+
+bool Scene::draw_id_supported() {
+	static bool supported = SDL_GL_ExtensionSupported("GL_ARB_shader_draw_parameters");
+	return supported;
+}
+
 void Scene::draw(glm::mat4 const &world_to_clip, Object::ProgramType program_type) const {
+	DrawList list;
+	prepare(world_to_clip, program_type, &list);
+	submit(list);
+}
+
+void Scene::DrawList::clear() {
+	batched.clear();
+	object_data.clear();
+	firsts.clear();
+	counts.clear();
+	run_ends.clear();
+	single.clear();
+}
+
+namespace {
+	//objects per chunk when preparing draw lists in parallel:
+	// (below this, handing work to other threads costs more than the matrix math)
+	constexpr uint32_t PrepareObjectsPerChunk = 512;
+}
+
+void Scene::prepare(glm::mat4 const &world_to_clip, Object::ProgramType program_type, DrawList *list_) const {
 	assert(program_type < Object::ProgramTypes);
+	assert(list_);
+	auto &list = *list_;
+
+	list.clear();
+	list.program_type = program_type;
 
-	for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
+	//figure out which objects to draw:
+	std::vector< Scene::Object * > visible;
+	if (!bvh.dirty) {
+		cull(world_to_clip, &visible);
+	} else {
+		//BVH isn't built yet, so draw everything:
+		for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
+			visible.emplace_back(object);
+		}
+	}
 
+	//split into objects that can be drawn in batches and objects that need their own uniforms:
+	std::vector< Scene::Object * > batched;
+	std::vector< Scene::Object * > single;
+	for (Scene::Object *object : visible) {
+		Object::ProgramInfo const &info = object->programs[program_type];
 		//don't draw if no program of this type attached to object:
-		if (object->programs[program_type].program == 0) continue;
+		if (info.program == 0) continue;
+		if (info.object_base_int != -1U && !info.set_uniforms) batched.emplace_back(object);
+		else single.emplace_back(object);
+	}
 
-		glm::mat4 local_to_world = object->transform->make_local_to_world();
+	//sort batched objects so that objects with the same state are adjacent:
+	auto state_less = [program_type](Scene::Object const *a_, Scene::Object const *b_) {
+		Object::ProgramInfo const &a = a_->programs[program_type];
+		Object::ProgramInfo const &b = b_->programs[program_type];
+		if (a.program != b.program) return a.program < b.program;
+		if (a.vao != b.vao) return a.vao < b.vao;
+		for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
+			if (a.textures[i] != b.textures[i]) return a.textures[i] < b.textures[i];
+		}
+		return false;
+	};
+	std::stable_sort(batched.begin(), batched.end(), state_less);
+
+	list.batched.reserve(batched.size());
+	list.firsts.reserve(batched.size());
+	list.counts.reserve(batched.size());
+	for (uint32_t i = 0; i < batched.size(); ++i) {
+		Object::ProgramInfo const &info = batched[i]->programs[program_type];
+		if (i > 0 && state_less(batched[i-1], batched[i])) list.run_ends.emplace_back(i);
+		list.batched.emplace_back(&info);
+		list.firsts.emplace_back(info.start);
+		list.counts.emplace_back(info.count);
+	}
+	if (!batched.empty()) list.run_ends.emplace_back(uint32_t(batched.size()));
 
-		//compute modelview+projection (object space to clip space) matrix for this object:
-		glm::mat4 mvp = world_to_clip * local_to_world;
+	//world matrices (and normal matrices, when the program uses them) were cached by update_bvh(),
+	// and can be used unless objects were added since or the object's transform (or an ancestor) has moved:
+	bool cached = !bvh.dirty;
+	auto cache_current = [cached](Scene::Object const *object) {
+		return cached && object->transform->world_cache_current();
+	};
+	auto local_to_world = [](Scene::Object const *object, bool current) {
+		return (current ? object->transform->world_cache : object->transform->make_local_to_world());
+	};
+	auto normal_to_world = [](Scene::Object const *object, bool current, glm::mat4 const &local_to_world) {
+		return (current ? object->transform->normal_cache : make_normal_matrix(glm::mat3(local_to_world)));
+	};
 
-		//compute modelview (object space to camera local space) matrix for this object:
-		glm::mat4x3 mv = glm::mat4x3(local_to_world);
+	//compute matrices (each chunk writes a disjoint range):
+	list.object_data.resize(batched.size() * ObjectDataStride);
+	parallel_chunks(uint32_t(batched.size()), PrepareObjectsPerChunk, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			bool current = cache_current(batched[i]);
+			glm::mat4 mv = local_to_world(batched[i], current);
+			glm::mat4 mvp = world_to_clip * mv;
+			glm::vec4 *out = &list.object_data[i * ObjectDataStride];
+			for (uint32_t c = 0; c < 4; ++c) *(out++) = mvp[c];
+			for (uint32_t c = 0; c < 4; ++c) *(out++) = glm::vec4(glm::vec3(mv[c]), 0.0f);
+			if (list.batched[i]->object_data_normals) {
+				glm::mat3 itmv = normal_to_world(batched[i], current, mv);
+				for (uint32_t c = 0; c < 3; ++c) *(out++) = glm::vec4(itmv[c], 0.0f);
+			} else {
+				for (uint32_t c = 0; c < 3; ++c) *(out++) = glm::vec4(0.0f);
+			}
+		}
+	});
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+	list.single.resize(single.size());
+	parallel_chunks(uint32_t(single.size()), PrepareObjectsPerChunk, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			bool current = cache_current(single[i]);
+			glm::mat4 mv = local_to_world(single[i], current);
+			DrawList::Single &out = list.single[i];
+			out.info = &single[i]->programs[program_type];
 
+			//compute modelview+projection (object space to clip space) matrix for this object:
+			out.mvp = world_to_clip * mv;
+
+			//compute modelview (object space to camera local space) matrix for this object:
+			out.mv = glm::mat4x3(mv);
+
+			//normal matrix only if the program wants it:
+			out.itmv = (out.info->itmv_mat3 != -1U ? normal_to_world(single[i], current, mv) : glm::mat3(1.0f));
+		}
+	});
+}
+
+void Scene::submit(DrawList const &list) const {
+	if (!list.batched.empty()) {
+		if (object_data_buffer == 0) {
+			glGenBuffers(1, &object_data_buffer);
+			glGenTextures(1, &object_data_tex);
+			glBindBuffer(GL_TEXTURE_BUFFER, object_data_buffer);
+			glBindTexture(GL_TEXTURE_BUFFER, object_data_tex);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, object_data_buffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+
+		//buffer textures may be as small as 64k texels, so upload + draw in chunks of at most this many objects:
+		static uint32_t const ChunkObjects = [](){
+			GLint max_texels = 0;
+			glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+			return std::max(1u, uint32_t(max_texels) / uint32_t(ObjectDataStride));
+		}();
+
+		glActiveTexture(GL_TEXTURE0 + ObjectDataTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, object_data_tex);
+
+		uint32_t run = 0;
+		for (uint32_t chunk_begin = 0; chunk_begin < list.batched.size(); chunk_begin += ChunkObjects) {
+			uint32_t chunk_end = std::min(uint32_t(list.batched.size()), chunk_begin + ChunkObjects);
+
+			glBindBuffer(GL_TEXTURE_BUFFER, object_data_buffer);
+			glBufferData(GL_TEXTURE_BUFFER, (chunk_end - chunk_begin) * ObjectDataStride * sizeof(glm::vec4), &list.object_data[chunk_begin * ObjectDataStride], GL_STREAM_DRAW);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+			//draw runs of objects with the same state (runs may straddle chunks):
+			for (uint32_t begin = chunk_begin; begin < chunk_end; /* later */) {
+				while (list.run_ends[run] <= begin) ++run;
+				uint32_t end = std::min(chunk_end, list.run_ends[run]);
+
+				Object::ProgramInfo const &info = *list.batched[begin];
+				glUseProgram(info.program);
+				for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
+					if (info.textures[i] != 0) {
+						glActiveTexture(GL_TEXTURE0 + i);
+						glBindTexture(GL_TEXTURE_2D, info.textures[i]);
+					}
+				}
+				glBindVertexArray(info.vao);
+
+				if (draw_id_supported()) {
+					glUniform1i(info.object_base_int, begin - chunk_begin);
+					glMultiDrawArrays(GL_TRIANGLES, &list.firsts[begin], &list.counts[begin], GLsizei(end - begin));
+				} else {
+					for (uint32_t i = begin; i < end; ++i) {
+						glUniform1i(info.object_base_int, i - chunk_begin);
+						glDrawArrays(GL_TRIANGLES, list.firsts[i], list.counts[i]);
+					}
+				}
+
+				begin = end;
+			}
+		}
+
+		glActiveTexture(GL_TEXTURE0 + ObjectDataTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		GL_ERRORS();
+	}
+
+	for (DrawList::Single const &single : list.single) {
 		//set up program uniforms:
-		Object::ProgramInfo const &info = object->programs[program_type];
+		Object::ProgramInfo const &info = *single.info;
 		glUseProgram(info.program);
 		if (info.mvp_mat4 != -1U) {
-			glUniformMatrix4fv(info.mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
+			glUniformMatrix4fv(info.mvp_mat4, 1, GL_FALSE, glm::value_ptr(single.mvp));
 		}
 		if (info.mv_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(info.mv_mat4x3, 1, GL_FALSE, glm::value_ptr(mv));
+			glUniformMatrix4x3fv(info.mv_mat4x3, 1, GL_FALSE, glm::value_ptr(single.mv));
 		}
 		if (info.itmv_mat3 != -1U) {
-			glUniformMatrix3fv(info.itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
+			glUniformMatrix3fv(info.itmv_mat3, 1, GL_FALSE, glm::value_ptr(single.itmv));
 		}
 
 		if (info.set_uniforms) info.set_uniforms();
@@ -254,7 +565,414 @@ void Scene::draw(glm::mat4 const &world_to_clip, Object::ProgramType program_typ
 }
 
 
+//---------------------------
+
+namespace {
+	//relative costs used by the surface area heuristic:
+	constexpr float BVHTraversalCost = 1.0f;
+	constexpr float BVHIntersectCost = 1.0f;
+	//leaves are never larger than this:
+	constexpr uint32_t BVHMaxLeafSize = 8;
+	//number of bins used when searching for a split:
+	constexpr uint32_t BVHBins = 16;
+	//tree is rebuilt when refitting makes it this much more expensive than when it was built:
+	constexpr float BVHRebuildRatio = 1.5f;
+	//nodes this deep are split at the median rather than by the surface area heuristic,
+	// so (halving down to leaves of BVHMaxLeafSize) no node is deeper than BVHMaxDepth:
+	constexpr uint32_t BVHSAHDepth = 32;
+	constexpr uint32_t BVHMaxDepth = 64;
+	static_assert(BVHSAHDepth + 32 <= BVHMaxDepth, "median splits of up to 2^32 objects fit under BVHMaxDepth");
+
+	//node indices waiting to be visited by a depth-first walk of the tree:
+	// (each visit replaces a node with at most its two children, so this never holds more than BVHMaxDepth + 1)
+	struct NodeStack {
+		uint32_t nodes[BVHMaxDepth + 1];
+		uint32_t count = 0;
+		void push(uint32_t node) {
+			assert(count < BVHMaxDepth + 1);
+			nodes[count++] = node;
+		}
+		uint32_t pop() { return nodes[--count]; }
+		bool empty() const { return count == 0; }
+	};
+
+	float half_area(glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 d = max - min;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	//SAH cost of the whole tree (relative to a root leaf of cost 'BVHIntersectCost' per object):
+	float bvh_cost(Scene::BVH const &bvh) {
+		if (bvh.nodes.empty()) return 0.0f;
+		float root_area = half_area(bvh.nodes[0].min, bvh.nodes[0].max);
+		if (root_area <= 0.0f) return float(bvh.objects.size()) * BVHIntersectCost;
+		float cost = 0.0f;
+		for (auto const &node : bvh.nodes) {
+			float area = half_area(node.min, node.max) / root_area;
+			if (node.count == 0) cost += area * BVHTraversalCost;
+			else cost += area * node.count * BVHIntersectCost;
+		}
+		return cost;
+	}
+
+	void build_bvh(Scene::BVH &bvh, Scene::Object *first_object) {
+		bvh.nodes.clear();
+		bvh.objects.clear();
+		bvh.unbounded.clear();
+		bvh.dirty = false;
+
+		for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
+			if (object->has_bbox()) bvh.objects.emplace_back(object);
+			else bvh.unbounded.emplace_back(object);
+		}
+		if (bvh.objects.empty()) {
+			bvh.built_cost = 0.0f;
+			return;
+		}
+
+		auto centroid = [](Scene::Object const *object) {
+			return 0.5f * (object->world_min + object->world_max);
+		};
+
+		struct Task {
+			uint32_t node;
+			uint32_t begin, end;
+			uint32_t depth;
+		};
+		std::vector< Task > todo;
+		bvh.nodes.emplace_back();
+		todo.emplace_back(Task{0, 0, uint32_t(bvh.objects.size()), 0});
+
+		while (!todo.empty()) {
+			Task task = todo.back();
+			todo.pop_back();
+
+			//compute bounds of objects and of their centroids:
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+			glm::vec3 cmin = min;
+			glm::vec3 cmax = max;
+			for (uint32_t i = task.begin; i < task.end; ++i) {
+				Scene::Object const *object = bvh.objects[i];
+				min = glm::min(min, object->world_min);
+				max = glm::max(max, object->world_max);
+				glm::vec3 c = centroid(object);
+				cmin = glm::min(cmin, c);
+				cmax = glm::max(cmax, c);
+			}
+			bvh.nodes[task.node].min = min;
+			bvh.nodes[task.node].max = max;
+
+			uint32_t count = task.end - task.begin;
+			float leaf_cost = count * BVHIntersectCost;
+
+			//find best binned split along any axis (unless deep enough to only split at the median):
+			float best_cost = std::numeric_limits< float >::infinity();
+			uint32_t best_axis = 0;
+			uint32_t best_bin = 0;
+			if (count > 1 && task.depth < BVHSAHDepth) {
+				float area = half_area(min, max);
+				for (uint32_t axis = 0; axis < 3; ++axis) {
+					float extent = cmax[axis] - cmin[axis];
+					if (!(extent > 0.0f)) continue;
+
+					struct Bin {
+						glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+						glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+						uint32_t count = 0;
+					} bins[BVHBins];
+					for (uint32_t i = task.begin; i < task.end; ++i) {
+						Scene::Object const *object = bvh.objects[i];
+						uint32_t b = std::min(BVHBins - 1, uint32_t(BVHBins * (centroid(object)[axis] - cmin[axis]) / extent));
+						bins[b].min = glm::min(bins[b].min, object->world_min);
+						bins[b].max = glm::max(bins[b].max, object->world_max);
+						bins[b].count += 1;
+					}
+
+					//sweep from the right to get cost of everything right of each split:
+					float right_cost[BVHBins];
+					{
+						Bin acc;
+						for (uint32_t b = BVHBins - 1; b > 0; --b) {
+							acc.min = glm::min(acc.min, bins[b].min);
+							acc.max = glm::max(acc.max, bins[b].max);
+							acc.count += bins[b].count;
+							right_cost[b] = (acc.count ? half_area(acc.min, acc.max) * acc.count : 0.0f);
+						}
+					}
+					//sweep from the left, splitting before bin 'b':
+					Bin acc;
+					for (uint32_t b = 1; b < BVHBins; ++b) {
+						acc.min = glm::min(acc.min, bins[b-1].min);
+						acc.max = glm::max(acc.max, bins[b-1].max);
+						acc.count += bins[b-1].count;
+						float left_cost = (acc.count ? half_area(acc.min, acc.max) * acc.count : 0.0f);
+						float cost = BVHTraversalCost + BVHIntersectCost * (left_cost + right_cost[b]) / area;
+						if (cost < best_cost) {
+							best_cost = cost;
+							best_axis = axis;
+							best_bin = b;
+						}
+					}
+				}
+			}
+
+			if (count <= BVHMaxLeafSize && !(best_cost < leaf_cost)) {
+				//make a leaf:
+				bvh.nodes[task.node].first = task.begin;
+				bvh.nodes[task.node].count = count;
+				continue;
+			}
+
+			//split objects:
+			auto begin = bvh.objects.begin() + task.begin;
+			auto end = bvh.objects.begin() + task.end;
+			auto middle = begin;
+			if (best_cost < std::numeric_limits< float >::infinity()) {
+				float extent = cmax[best_axis] - cmin[best_axis];
+				middle = std::partition(begin, end, [&](Scene::Object const *object){
+					uint32_t b = std::min(BVHBins - 1, uint32_t(BVHBins * (centroid(object)[best_axis] - cmin[best_axis]) / extent));
+					return b < best_bin;
+				});
+			}
+			if (middle == begin || middle == end) {
+				//no useful split (e.g., all centroids coincide), so split in the middle:
+				middle = begin + count / 2;
+				uint32_t axis = 0;
+				glm::vec3 extent = cmax - cmin;
+				if (extent.y > extent[axis]) axis = 1;
+				if (extent.z > extent[axis]) axis = 2;
+				std::nth_element(begin, middle, end, [&](Scene::Object const *a, Scene::Object const *b){
+					return centroid(a)[axis] < centroid(b)[axis];
+				});
+			}
+
+			uint32_t first_child = uint32_t(bvh.nodes.size());
+			bvh.nodes[task.node].first = first_child;
+			bvh.nodes[task.node].count = 0;
+			bvh.nodes.emplace_back();
+			bvh.nodes.emplace_back();
+			uint32_t split = uint32_t(middle - bvh.objects.begin());
+			todo.emplace_back(Task{first_child, task.begin, split, task.depth + 1});
+			todo.emplace_back(Task{first_child + 1, split, task.end, task.depth + 1});
+		}
+
+		bvh.built_cost = bvh_cost(bvh);
+	}
+
+	//distance along ray at which it enters box (or infinity if it misses):
+	float ray_box(glm::vec3 const &origin, glm::vec3 const &inv_direction, glm::vec3 const &min, glm::vec3 const &max, float t_max) {
+		glm::vec3 t0 = (min - origin) * inv_direction;
+		glm::vec3 t1 = (max - origin) * inv_direction;
+		glm::vec3 tmin = glm::min(t0, t1);
+		glm::vec3 tmax = glm::max(t0, t1);
+		float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+		float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, t_max));
+		if (enter <= exit) return enter;
+		else return std::numeric_limits< float >::infinity();
+	}
+
+	float point_box_dis2(glm::vec3 const &pt, glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 d = glm::max(glm::max(min - pt, pt - max), glm::vec3(0.0f));
+		return glm::dot(d, d);
+	}
+}
+
+void Scene::update_bvh() {
+	//cache world (and, where needed, normal) matrices and compute world-space bounding boxes:
+	for (Object *object = first_object; object != nullptr; object = object->alloc_next) {
+		glm::mat4 local_to_world = object->transform->make_local_to_world();
+		object->transform->world_cache = local_to_world;
+		for (Transform *t = object->transform; t != nullptr; t = t->parent) {
+			t->cached_position = t->position;
+			t->cached_rotation = t->rotation;
+			t->cached_scale = t->scale;
+			t->cached_parent = t->parent;
+			t->cached = true;
+		}
+		for (uint32_t i = 0; i < Object::ProgramTypes; ++i) {
+			if (object->programs[i].program != 0 && object->programs[i].uses_normal_matrix()) {
+				object->transform->normal_cache = make_normal_matrix(glm::mat3(local_to_world));
+				break;
+			}
+		}
+
+		if (!object->has_bbox()) continue;
+		glm::vec3 center = 0.5f * (object->bbox_max + object->bbox_min);
+		glm::vec3 radius = 0.5f * (object->bbox_max - object->bbox_min);
+		glm::vec3 world_center = glm::vec3(local_to_world * glm::vec4(center, 1.0f));
+		glm::vec3 world_radius =
+			  glm::abs(glm::vec3(local_to_world[0])) * radius.x
+			+ glm::abs(glm::vec3(local_to_world[1])) * radius.y
+			+ glm::abs(glm::vec3(local_to_world[2])) * radius.z;
+		object->world_min = world_center - world_radius;
+		object->world_max = world_center + world_radius;
+	}
+
+	if (bvh.dirty) {
+		build_bvh(bvh, first_object);
+		return;
+	}
+
+	//refit (children always come after their parents in the node list):
+	for (auto ni = bvh.nodes.rbegin(); ni != bvh.nodes.rend(); ++ni) {
+		BVH::Node &node = *ni;
+		if (node.count == 0) {
+			BVH::Node const &a = bvh.nodes[node.first];
+			BVH::Node const &b = bvh.nodes[node.first + 1];
+			node.min = glm::min(a.min, b.min);
+			node.max = glm::max(a.max, b.max);
+		} else {
+			node.min = glm::vec3( std::numeric_limits< float >::infinity());
+			node.max = glm::vec3(-std::numeric_limits< float >::infinity());
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				node.min = glm::min(node.min, bvh.objects[i]->world_min);
+				node.max = glm::max(node.max, bvh.objects[i]->world_max);
+			}
+		}
+	}
+
+	//rebuild if objects have moved enough to make the tree much worse:
+	if (bvh_cost(bvh) > BVHRebuildRatio * bvh.built_cost) {
+		build_bvh(bvh, first_object);
+	}
+}
+
+void Scene::cull(glm::mat4 const &world_to_clip, std::vector< Object * > *visible) const {
+	assert(visible);
+	assert(!bvh.dirty && "Must call update_bvh() before culling.");
+
+	visible->insert(visible->end(), bvh.unbounded.begin(), bvh.unbounded.end());
+	if (bvh.nodes.empty()) return;
+
+	//extract frustum planes (points with dot(plane, (x,1)) < 0 are outside):
+	glm::vec4 rows[4];
+	for (uint32_t r = 0; r < 4; ++r) {
+		rows[r] = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+	}
+	glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2], rows[3] - rows[2],
+	};
+	auto outside = [&planes](glm::vec3 const &min, glm::vec3 const &max) {
+		for (auto const &plane : planes) {
+			//test the box corner furthest along the plane normal:
+			glm::vec3 corner(
+				plane.x > 0.0f ? max.x : min.x,
+				plane.y > 0.0f ? max.y : min.y,
+				plane.z > 0.0f ? max.z : min.z
+			);
+			if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return true;
+		}
+		return false;
+	};
+
+	NodeStack todo;
+	todo.push(0);
+	while (!todo.empty()) {
+		BVH::Node const &node = bvh.nodes[todo.pop()];
+		if (outside(node.min, node.max)) continue;
+		if (node.count == 0) {
+			todo.push(node.first + 1);
+			todo.push(node.first);
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				Object *object = bvh.objects[i];
+				if (!outside(object->world_min, object->world_max)) visible->emplace_back(object);
+			}
+		}
+	}
+}
+
+Scene::Object *Scene::pick(glm::vec3 const &origin, glm::vec3 const &direction, float *distance) const {
+	assert(!bvh.dirty && "Must call update_bvh() before picking.");
+
+	Object *closest = nullptr;
+	float closest_t = std::numeric_limits< float >::infinity();
+	if (bvh.nodes.empty()) return closest;
+
+	glm::vec3 inv_direction = 1.0f / direction;
+
+	NodeStack todo;
+	if (ray_box(origin, inv_direction, bvh.nodes[0].min, bvh.nodes[0].max, closest_t) < closest_t) {
+		todo.push(0);
+	}
+	while (!todo.empty()) {
+		BVH::Node const &node = bvh.nodes[todo.pop()];
+		if (node.count == 0) {
+			//visit the nearer child first:
+			float ta = ray_box(origin, inv_direction, bvh.nodes[node.first].min, bvh.nodes[node.first].max, closest_t);
+			float tb = ray_box(origin, inv_direction, bvh.nodes[node.first+1].min, bvh.nodes[node.first+1].max, closest_t);
+			if (ta <= tb) {
+				if (tb < closest_t) todo.push(node.first + 1);
+				if (ta < closest_t) todo.push(node.first);
+			} else {
+				if (ta < closest_t) todo.push(node.first);
+				if (tb < closest_t) todo.push(node.first + 1);
+			}
+		} else {
+			//NOTE: the node may have been pushed before a closer hit was found; ray_box() culls against closest_t anyway.
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				Object *object = bvh.objects[i];
+				float t = ray_box(origin, inv_direction, object->world_min, object->world_max, closest_t);
+				if (t < closest_t) {
+					closest_t = t;
+					closest = object;
+				}
+			}
+		}
+	}
+
+	if (closest && distance) *distance = closest_t;
+	return closest;
+}
+
+Scene::Object *Scene::nearest(glm::vec3 const &point, float *distance) const {
+	assert(!bvh.dirty && "Must call update_bvh() before querying.");
+
+	Object *closest = nullptr;
+	float closest_dis2 = std::numeric_limits< float >::infinity();
+	if (bvh.nodes.empty()) return closest;
+
+	NodeStack todo;
+	todo.push(0);
+	while (!todo.empty()) {
+		BVH::Node const &node = bvh.nodes[todo.pop()];
+		if (point_box_dis2(point, node.min, node.max) >= closest_dis2) continue;
+		if (node.count == 0) {
+			//visit the nearer child first:
+			BVH::Node const &a = bvh.nodes[node.first];
+			BVH::Node const &b = bvh.nodes[node.first + 1];
+			if (point_box_dis2(point, a.min, a.max) <= point_box_dis2(point, b.min, b.max)) {
+				todo.push(node.first + 1);
+				todo.push(node.first);
+			} else {
+				todo.push(node.first);
+				todo.push(node.first + 1);
+			}
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				Object *object = bvh.objects[i];
+				float dis2 = point_box_dis2(point, object->world_min, object->world_max);
+				if (dis2 < closest_dis2) {
+					closest_dis2 = dis2;
+					closest = object;
+				}
+			}
+		}
+	}
+
+	if (closest && distance) *distance = std::sqrt(closest_dis2);
+	return closest;
+}
+
+
 Scene::~Scene() {
+	if (object_data_buffer != 0) {
+		glDeleteBuffers(1, &object_data_buffer);
+		glDeleteTextures(1, &object_data_tex);
+	}
 	while (first_camera) {
 		delete_camera(first_camera);
 	}
@@ -269,10 +987,12 @@ Scene::~Scene() {
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_object) {
 
-	std::ifstream file(filename, std::ios::binary);
+	ChunkFile file(filename);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	//names are copied to a table owned by the scene, so transform names can point into it:
+	auto str0 = file.read< char >("str0");
+	name_tables.emplace_back(str0.begin(), str0.end());
+	std::vector< char > &names = name_tables.back();
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -283,8 +1003,7 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	auto hierarchy = file.read< HierarchyEntry >("xfh0");
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -292,8 +1011,7 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	auto meshes = file.read< MeshEntry >("msh0");
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -302,8 +1020,7 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	auto cameras = file.read< CameraEntry >("cam0");
 
 	struct LightEntry {
 		uint32_t transform;
@@ -314,10 +1031,9 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lamps;
-	read_chunk(file, "lmp0", &lamps);
+	auto lamps = file.read< LightEntry >("lmp0");
 
-	if (file.peek() != EOF) {
+	if (!file.at_end()) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -337,7 +1053,8 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			t->name = Name(names.data() + h.name_begin, names.data() + h.name_end);
+			if (t->name.size()) transform_index.emplace(t->name, t);
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -9,13 +9,50 @@
 #include <list>
 #include <functional>
 #include <string>
+#include <limits>
+#include <unordered_map>
+#include <cstring>
 
 //"Scene" manages a hierarchy of transformations with, potentially, attached information.
 struct Scene {
 
+	//"Name"s point into string tables owned by the scene (so names don't need their own allocations):
+	struct Name {
+		char const *begin = nullptr;
+		char const *end = nullptr;
+
+		Name() = default;
+		Name(char const *begin_, char const *end_) : begin(begin_), end(end_) { }
+		//for lookups and comparisons only -- the Name points into 'str', so it must not outlive it
+		// (to give a transform a name, use Scene::set_name()):
+		explicit Name(std::string const &str) : begin(str.data()), end(str.data() + str.size()) { }
+
+		size_t size() const { return end - begin; }
+		std::string str() const { return std::string(begin, end); }
+
+		bool operator==(Name const &other) const {
+			return size() == other.size() && std::memcmp(begin, other.begin, size()) == 0;
+		}
+		bool operator!=(Name const &other) const { return !(*this == other); }
+		bool operator==(std::string const &other) const { return *this == Name(other); }
+		bool operator!=(std::string const &other) const { return !(*this == other); }
+		bool operator==(char const *other) const { return *this == Name(other, other + std::strlen(other)); }
+		bool operator!=(char const *other) const { return !(*this == other); }
+	};
+	struct NameHash {
+		size_t operator()(Name const &name) const {
+			//FNV-1a:
+			uint32_t hash = 2166136261u;
+			for (char const *c = name.begin; c != name.end; ++c) {
+				hash = (hash ^ uint8_t(*c)) * 16777619u;
+			}
+			return hash;
+		}
+	};
+
 	struct Transform {
 		//useful to know sometimes:
-		std::string name;
+		Name name;
 
 		//simple specification:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -41,6 +78,20 @@ struct Scene {
 		glm::mat4 make_local_to_world() const;
 		glm::mat4 make_world_to_local() const;
 
+		//cached by Scene::update_bvh() for transforms with objects attached:
+		glm::mat4 world_cache = glm::mat4(1.0f); //make_local_to_world()
+		glm::mat3 normal_cache = glm::mat3(1.0f); //inverse transpose of world_cache (only if an attached object's program uses normals)
+
+		//are the caches still right? (false if this transform or any of its ancestors changed since update_bvh())
+		bool world_cache_current() const;
+
+		//local state as of the last update_bvh() (kept for cached transforms and their ancestors), for world_cache_current():
+		glm::vec3 cached_position = glm::vec3(0.0f);
+		glm::quat cached_rotation = glm::quat(0.0f, 0.0f, 0.0f, 1.0f);
+		glm::vec3 cached_scale = glm::vec3(1.0f);
+		Transform *cached_parent = nullptr;
+		bool cached = false;
+
 		//constructor/destructor:
 		Transform() = default;
 		Transform(Transform &) = delete;
@@ -85,11 +136,35 @@ struct Scene {
 			GLuint itmv_mat3 = -1U; //uniform index for normal-to-lighting-space matrix (mat3)
 			std::function< void() > set_uniforms; //(optional) function to set additional uniforms
 
+			//batched drawing:
+			// programs that read per-object matrices from Scene's object data (see Scene::object_data_glsl())
+			// give the location of their 'object_base' uniform here; objects without 'set_uniforms' that share
+			// program, vao, and textures are then drawn with one glMultiDrawArrays call.
+			GLuint object_base_int = -1U; //uniform index for first object data index of the draw (int)
+			bool object_data_normals = true; //does the batched program call normal_to_light_data()? (if not, normal matrices are skipped)
+
+			//does drawing with this program need a normal-to-lighting-space matrix?
+			bool uses_normal_matrix() const {
+				return (object_base_int != -1U ? object_data_normals : itmv_mat3 != -1U);
+			}
+
 			//textures:
 			enum : uint32_t { TextureCount = 4 };
 			GLuint textures[TextureCount] = {0,0,0,0}; //textures to bind
 		} programs[ProgramTypes];
 
+		//bounding box in local (transform) space, used for culling and picking:
+		// (objects with an empty box -- the default -- are never culled and never picked)
+		glm::vec3 bbox_min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 bbox_max = glm::vec3(-std::numeric_limits< float >::infinity());
+		bool has_bbox() const {
+			return bbox_min.x <= bbox_max.x && bbox_min.y <= bbox_max.y && bbox_min.z <= bbox_max.z;
+		}
+
+		//world-space bounding box, computed by Scene::update_bvh():
+		glm::vec3 world_min = glm::vec3(0.0f);
+		glm::vec3 world_max = glm::vec3(0.0f);
+
 		//used by Scene to manage allocation:
 		Object **alloc_prev_next = nullptr;
 		Object *alloc_next = nullptr;
@@ -178,6 +253,26 @@ struct Scene {
 	Camera *first_camera = nullptr;
 	//(you shouldn't be manipulating these pointers directly
 
+	//------ functions to find scene things by name ------
+
+	//Look up a transform, camera, or lamp by its (transform's) name:
+	// returns nullptr if nothing has that name; throws if more than one thing has that name.
+	Transform *lookup_transform(std::string const &name) const;
+	Camera *lookup_camera(std::string const &name) const;
+	Lamp *lookup_lamp(std::string const &name) const;
+
+	//Name (or rename) a transform, keeping the indices above up to date:
+	// (the name is copied into name_tables, so 'name' need not outlive the call; an empty name removes the transform from the indices)
+	void set_name(Transform *transform, std::string const &name);
+
+	//string tables holding names (one per loaded file, plus one per set_name() call):
+	std::list< std::vector< char > > name_tables;
+
+	//indices from name to things, built by load() and kept up to date by set_name(), new_camera(), and new_lamp():
+	std::unordered_multimap< Name, Transform *, NameHash > transform_index;
+	std::unordered_multimap< Name, Camera *, NameHash > camera_index;
+	std::unordered_multimap< Name, Lamp *, NameHash > lamp_index;
+
 	//------ functions to traverse the scene ------
 
 	//Draw the scene from a given camera by computing appropriate matrices and sending all objects to OpenGL:
@@ -189,10 +284,103 @@ struct Scene {
 	void draw(Lamp const *lamp, Object::ProgramType = Object::ProgramTypeDefault ) const;
 
 	//More general draw function. Will render with a specified projection transformation and use programs in the given slot of all objects:
+	// (if the BVH is built, objects outside the view frustum -- as of the last update_bvh() -- are skipped,
+	//  and matrices cached by update_bvh() are used for transforms that haven't changed since)
 	void draw(
 		glm::mat4 const &world_to_clip,
 		Object::ProgramType program_type) const;
 
+	//Drawing can also be split into a CPU-only "prepare" phase (visibility, matrices, sorting)
+	// and an OpenGL "submit" phase. draw() is just prepare() followed by submit().
+	struct DrawList {
+		Object::ProgramType program_type = Object::ProgramTypeDefault;
+
+		//batched objects (sorted by program, vao, and textures):
+		std::vector< Object::ProgramInfo const * > batched;
+		std::vector< glm::vec4 > object_data; //ObjectDataStride texels per batched object
+		std::vector< GLint > firsts; //per batched object
+		std::vector< GLsizei > counts; //per batched object
+		std::vector< uint32_t > run_ends; //batched[run_ends[i-1] .. run_ends[i]) all share state
+
+		//objects that need their own uniforms:
+		struct Single {
+			Object::ProgramInfo const *info;
+			glm::mat4 mvp;
+			glm::mat4x3 mv;
+			glm::mat3 itmv;
+		};
+		std::vector< Single > single;
+
+		void clear();
+	};
+
+	//Fill 'list' with everything needed to draw the scene with the given projection and program slot.
+	// does not touch OpenGL, so it may be called from any thread (several at once, even) as long as
+	// nothing modifies the scene in the meantime. Large lists are prepared using several threads.
+	void prepare(
+		glm::mat4 const &world_to_clip,
+		Object::ProgramType program_type,
+		DrawList *list) const;
+
+	//Send a prepared list to OpenGL (call on the thread that owns the GL context):
+	void submit(DrawList const &list) const;
+
+	//------ batched drawing ------
+
+	//Per-object matrices for batched programs are stored in a buffer texture bound to ObjectDataTextureUnit.
+	// each object uses ObjectDataStride texels: object_to_clip (4 columns), object_to_light (4 columns, xyz), normal_to_light (3 columns, xyz)
+	enum : uint32_t {
+		ObjectDataTextureUnit = Object::ProgramInfo::TextureCount,
+		ObjectDataStride = 4 + 4 + 3
+	};
+
+	//GLSL for batched programs to include directly after their '#version' line.
+	// declares the 'object_data' samplerBuffer and 'object_base' int uniforms and
+	// 'object_to_clip_data()', 'object_to_light_data()', and 'normal_to_light_data()' functions for use in vertex shaders.
+	// (NOTE: programs need to set 'object_data' to ObjectDataTextureUnit themselves.)
+	static std::string object_data_glsl();
+
+	//does the driver support gl_DrawIDARB? (otherwise batches are drawn with one glDrawArrays per object)
+	static bool draw_id_supported();
+
+	//buffer + buffer texture used to pass object data to programs (allocated on first use):
+	mutable GLuint object_data_buffer = 0;
+	mutable GLuint object_data_tex = 0;
+
+	//------ spatial queries ------
+
+	//"BVH" is a bounding volume hierarchy over the world-space bounding boxes of all objects:
+	struct BVH {
+		struct Node {
+			glm::vec3 min = glm::vec3(0.0f);
+			glm::vec3 max = glm::vec3(0.0f);
+			uint32_t first = 0; //first child node (if count == 0) or first index into 'objects' (if count > 0)
+			uint32_t count = 0; //number of objects in leaf (interior nodes have children 'first' and 'first+1')
+		};
+		std::vector< Node > nodes; //nodes[0] is the root
+		std::vector< Object * > objects; //objects referenced by leaves
+		std::vector< Object * > unbounded; //objects without a bounding box (always drawn)
+		float built_cost = 0.0f; //SAH cost of the tree right after it was last built
+		bool dirty = true; //objects were added or removed since the tree was last built
+	} bvh;
+
+	//Refit the BVH to the current transforms (rebuilding it if objects changed or it has degraded):
+	// call after moving transforms and before drawing or querying the scene.
+	// (drawing moved transforms without it still uses their new matrices, but culls them with their old bounds)
+	void update_bvh();
+
+	//Collect all objects whose bounding box may be visible through 'world_to_clip':
+	// (also includes all unbounded objects)
+	void cull(glm::mat4 const &world_to_clip, std::vector< Object * > *visible) const;
+
+	//Find the first object whose bounding box is hit by a ray:
+	// returns nullptr if no object is hit; otherwise sets *distance (if given) to the ray parameter of the hit.
+	Object *pick(glm::vec3 const &origin, glm::vec3 const &direction, float *distance = nullptr) const;
+
+	//Find the object whose bounding box is closest to a point:
+	// returns nullptr if the scene has no bounded objects; otherwise sets *distance (if given).
+	Object *nearest(glm::vec3 const &point, float *distance = nullptr) const;
+
 	~Scene(); //destructor deallocates transforms, objects, cameras
 
 	//add transforms/objects/cameras from a scene file:
@@ -2,10 +2,17 @@
 
 #include <SDL.h>
 
+//mix with SSE where it is available (always, on x86-64):
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SOUND_USE_SSE
+#include <xmmintrin.h>
+#endif
+
 #include <algorithm>
 #include <iostream>
-#include <list>
 #include <string>
+#include <atomic>
+#include <limits>
 
 namespace Sound {
 
@@ -98,17 +105,201 @@ void compute_pan_from_listener_and_position(
 	}
 }
 
-//list of all currently playing samples:
-std::list< std::shared_ptr< PlayingSample > > playing_samples;
+//a stereo output sample (or a pair of left/right gains):
+struct LR {
+	float l;
+	float r;
+};
+static_assert(sizeof(LR) == 8, "Sample is packed");
+
+//add 'count' mono samples from 'data' into 'out', with gains of pan + pan_step * index:
+void mix_span(float const *data, uint32_t count, LR *out, LR pan, LR pan_step) {
+	uint32_t i = 0;
+#ifdef SOUND_USE_SSE
+	//four samples at a time: scale by left and right gains, then interleave into two stereo pairs each:
+	float *out_lr = &out[0].l;
+	__m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 pan_l = _mm_set1_ps(pan.l);
+	__m128 pan_r = _mm_set1_ps(pan.r);
+	__m128 step_l = _mm_set1_ps(pan_step.l);
+	__m128 step_r = _mm_set1_ps(pan_step.r);
+	for (; i + 4 <= count; i += 4) {
+		//(gains for samples i through i+3 are computed from the start of the span, not accumulated, so rounding doesn't build up)
+		__m128 index = _mm_add_ps(_mm_set1_ps(float(i)), lanes);
+		__m128 gain_l = _mm_add_ps(pan_l, _mm_mul_ps(step_l, index));
+		__m128 gain_r = _mm_add_ps(pan_r, _mm_mul_ps(step_r, index));
+		__m128 d = _mm_loadu_ps(data + i);
+		__m128 l = _mm_mul_ps(d, gain_l);
+		__m128 r = _mm_mul_ps(d, gain_r);
+		_mm_storeu_ps(out_lr + 2 * i, _mm_add_ps(_mm_loadu_ps(out_lr + 2 * i), _mm_unpacklo_ps(l, r)));
+		_mm_storeu_ps(out_lr + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(out_lr + 2 * i + 4), _mm_unpackhi_ps(l, r)));
+	}
+#endif
+	//one at a time (the rest of the samples, or all of them without SSE):
+	for (; i < count; ++i) {
+		out[i].l += (pan.l + pan_step.l * i) * data[i];
+		out[i].r += (pan.r + pan_step.r * i) * data[i];
+	}
+}
+
+//voices, which the audio callback mixes (and only it touches, apart from the atomics):
+struct Voice {
+	std::vector< float > const *data = nullptr; //sample data being played (nullptr when the voice is free)
+	uint32_t i = 0; //next data value to read
+	bool loop = false; //should playback loop after data runs out?
+	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
+
+	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f);
+	Ramp< float > volume = Ramp< float >(1.0f);
+
+	uint32_t generation = 0; //generation of the sample now playing (commands for other generations are ignored)
+
+	//read by the game thread to know when voices free up, and which to steal:
+	std::atomic< uint32_t > finished{0}; //generation that has finished playing
+	std::atomic< float > loudness{0.0f}; //louder channel's gain at the end of the last mixed block
+	std::atomic< uint32_t > mixed{0}; //generation that 'loudness' was measured for (stored after 'loudness')
+};
+Voice voices[MaxVoices];
+
+//the game thread's view of the voices (only it touches these):
+// it picks voices for new samples itself, so that play() can return a handle right away.
+struct VoiceAllocation {
+	uint32_t generation = 0; //generation of the most recent sample started in the voice
+	uint64_t started = 0; //when that sample started (in play() calls), for StealOldest
+};
+VoiceAllocation allocations[MaxVoices];
+uint64_t plays = 0;
+StealPolicy steal_policy = StealOldest;
+
+//changes requested by the game, waiting to be applied by the audio callback:
+struct Command {
+	enum Type : uint32_t {
+		Play,
+		SetPosition,
+		SetVolume,
+		Stop,
+		SetListenerPosition,
+		SetListenerRight,
+		SetMasterVolume,
+		StopAll,
+	} type = Play;
+	uint32_t voice = -1U; //for Play and per-sample commands
+	uint32_t generation = 0; //(Play starts this generation in the voice; other commands only apply if it still matches)
+	std::vector< float > const *data = nullptr; //for Play
+	bool loop = false; //for Play
+	glm::vec3 vector = glm::vec3(0.0f);
+	float value = 0.0f;
+	float ramp = 0.0f;
+};
+
+//single-producer (game thread), single-consumer (audio callback) ring of commands:
+// slots [read, write) hold commands; each side only stores its own index, so neither ever waits for the other.
+constexpr const uint32_t CommandCapacity = 1024; //power of two, so indices can wrap freely
+Command commands[CommandCapacity];
+std::atomic< uint32_t > commands_write(0);
+std::atomic< uint32_t > commands_read(0);
+
+SDL_AudioDeviceID device = 0;
+bool offline = false; //mixed by mix_offline() rather than by an audio device's callback
+
+void stop_voice(Voice &voice, float ramp) {
+	if (!voice.stopped) {
+		voice.stopped = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+void apply(Command const &command) {
+	if (command.type == Command::Play) {
+		//(replaces whatever was playing, if the voice was stolen)
+		Voice &voice = voices[command.voice];
+		voice.data = command.data;
+		voice.i = 0;
+		voice.loop = command.loop;
+		voice.stopped = false;
+		voice.position.set(command.vector, 0.0f);
+		voice.volume.set(command.value, 0.0f);
+		voice.generation = command.generation;
+	} else if (command.type == Command::SetPosition || command.type == Command::SetVolume || command.type == Command::Stop) {
+		Voice &voice = voices[command.voice];
+		if (voice.data == nullptr || voice.generation != command.generation) return; //sample already finished
+		if (command.type == Command::SetPosition) voice.position.set(command.vector, command.ramp);
+		else if (command.type == Command::SetVolume) voice.volume.set(command.value, command.ramp);
+		else stop_voice(voice, command.ramp);
+	} else if (command.type == Command::SetListenerPosition) {
+		listener.position.set(command.vector, command.ramp);
+	} else if (command.type == Command::SetListenerRight) {
+		listener.right.set(command.vector, command.ramp);
+	} else if (command.type == Command::SetMasterVolume) {
+		volume.set(command.value, command.ramp);
+	} else if (command.type == Command::StopAll) {
+		for (auto &voice : voices) {
+			if (voice.data) stop_voice(voice, command.ramp);
+		}
+	}
+}
+
+//apply all queued commands (from the audio callback, or from a thread holding the audio lock):
+void drain_commands() {
+	uint32_t read = commands_read.load(std::memory_order_relaxed);
+	uint32_t write = commands_write.load(std::memory_order_acquire);
+	for (; read != write; ++read) {
+		apply(commands[read % CommandCapacity]);
+	}
+	commands_read.store(read, std::memory_order_release);
+}
+
+//queue a command for the audio callback (game thread only):
+void submit(Command const &command) {
+	if (!device && !offline) {
+		//no audio callback will ever run, so nothing else touches the state:
+		apply(command);
+		return;
+	}
+	uint32_t write = commands_write.load(std::memory_order_relaxed);
+	if (write - commands_read.load(std::memory_order_acquire) == CommandCapacity) {
+		//queue is full (the callback hasn't run in a while); make room by applying commands here:
+		// (offline, mixing happens on this thread, so there is nothing to lock)
+		lock();
+		drain_commands();
+		unlock();
+	}
+	commands[write % CommandCapacity] = command;
+	commands_write.store(write + 1, std::memory_order_release);
+}
+
+//pick a voice for a new sample (game thread only); returns -1U if none can be had:
+uint32_t allocate_voice() {
+	uint32_t best = -1U;
+	float best_loudness = std::numeric_limits< float >::infinity(); //(for StealQuietest)
+	for (uint32_t v = 0; v < MaxVoices; ++v) {
+		//free if nothing was ever started there, or if the callback has finished the latest sample started there:
+		// (a Play still in the queue hasn't finished, since 'finished' only moves forward to generations the callback has seen)
+		if (voices[v].finished.load(std::memory_order_acquire) == allocations[v].generation) return v;
+		if (steal_policy == StealOldest) {
+			if (best == -1U || allocations[v].started < allocations[best].started) best = v;
+		} else if (steal_policy == StealQuietest) {
+			//a sample that hasn't been mixed yet (its Play may still be queued) counts as loudest, since the
+			// voice's loudness is still that of what played there before; ties go to the sample started longest ago:
+			float loudness = std::numeric_limits< float >::infinity();
+			if (voices[v].mixed.load(std::memory_order_acquire) == allocations[v].generation) {
+				loudness = voices[v].loudness.load(std::memory_order_relaxed);
+			}
+			if (best == -1U || loudness < best_loudness || (loudness == best_loudness && allocations[v].started < allocations[best].started)) {
+				best = v;
+				best_loudness = loudness;
+			}
+		}
+	}
+	return best;
+}
 
 void mix_audio(void *, Uint8 *stream, int len) {
 	assert(stream); //should always have some audio buffer
 
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
 	assert(len == MixSamples * sizeof(LR)); //should always have the expected number of samples
 
 	LR *buffer = reinterpret_cast< LR * >(stream);
@@ -118,6 +309,9 @@ void mix_audio(void *, Uint8 *stream, int len) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
+
+	//bring the state up to date with what the game asked for since the last block:
+	drain_commands();
 	
 	//Figure out global info (listener position, volume) at start and end of mix period:
 	glm::vec3 start_position = listener.position.value;
@@ -132,9 +326,10 @@ void mix_audio(void *, Uint8 *stream, int len) {
 	glm::vec3 end_right = listener.right.value;
 	float end_volume = volume.value;
 
-	//now add audio for each playing sample:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		PlayingSample &source = **si; //iterator over shared pointers
+	//now add audio for each playing voice:
+	for (auto &source : voices) {
+		if (source.data == nullptr) continue;
+		std::vector< float > const &data = *source.data;
 
 		//Figure out sample panning/volume at start and end of the mix period:
 		LR start_pan;
@@ -150,39 +345,39 @@ void mix_audio(void *, Uint8 *stream, int len) {
 		end_pan.l *= end_volume * source.volume.value;
 		end_pan.r *= end_volume * source.volume.value;
 
-		LR pan = start_pan;
 		LR pan_step;
 		pan_step.l = (end_pan.l - start_pan.l) / MixSamples;
 		pan_step.r = (end_pan.r - start_pan.r) / MixSamples;
 
-		assert(source.i < source.data.size());
+		assert(source.i < data.size());
 
-		for (uint32_t i = 0; i < MixSamples; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * source.data[source.i];
-			buffer[i].r += pan.r * source.data[source.i];
+		//mix in spans that end where the block ends or the sample data runs out (and loops or stops):
+		for (uint32_t at = 0; at < MixSamples; /* later */) {
+			uint32_t count = std::min(MixSamples - at, uint32_t(data.size()) - source.i);
 
-			//update position in sample:
-			source.i += 1;
-			if (source.i == source.data.size()) {
+			LR pan;
+			pan.l = start_pan.l + pan_step.l * at;
+			pan.r = start_pan.r + pan_step.r * at;
+			mix_span(data.data() + source.i, count, buffer + at, pan, pan_step);
+
+			at += count;
+			source.i += count;
+			if (source.i == data.size()) {
 				if (source.loop) source.i = 0;
 				else break;
 			}
-
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
 		}
 
-		if (source.i >= source.data.size() //non-looping sample has finished
+		source.loudness.store(std::max(end_pan.l, end_pan.r), std::memory_order_relaxed);
+		source.mixed.store(source.generation, std::memory_order_release);
+
+		if (source.i >= data.size() //non-looping sample has finished
 		 || (source.stopped && source.volume.ramp == 0.0f) //sample has finished stopping
 		 ) {
-		 	source.stopped = true;
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
-		} else {
-			++si;
+			//free the voice:
+			source.data = nullptr;
+			source.stopped = true;
+			source.finished.store(source.generation, std::memory_order_release);
 		}
 	}
 
@@ -195,8 +390,6 @@ void mix_audio(void *, Uint8 *stream, int len) {
 
 };
 
-SDL_AudioDeviceID device = 0;
-
 } //end anon namespace
 
 //------------------
@@ -236,57 +429,93 @@ Sample::Sample(std::string const &filename) {
 	std::cout << "Range: " << min << ", " << max << std::endl;
 }
 
-std::shared_ptr< PlayingSample > Sample::play(glm::vec3 const &position, float volume, LoopOrOnce loop_or_once) const {
-	lock();
-	playing_samples.emplace_back(std::make_shared< PlayingSample >(this, position, volume, loop_or_once == Loop));
-	unlock();
-	return playing_samples.back();
+Sample::Sample(std::vector< float > const &data_) : data(data_) {
+}
+
+PlayingSample Sample::play(glm::vec3 const &position, float volume, LoopOrOnce loop_or_once) const {
+	PlayingSample playing;
+	if (data.empty()) return playing; //(nothing to play)
+	playing.voice = allocate_voice();
+	if (playing.voice == -1U) return playing;
+
+	VoiceAllocation &allocation = allocations[playing.voice];
+	allocation.generation += 1;
+	if (allocation.generation == 0) allocation.generation = 1; //(0 is what 'finished' starts at, so would read as already done)
+	allocation.started = plays++;
+	playing.generation = allocation.generation;
+
+	Command command;
+	command.type = Command::Play;
+	command.voice = playing.voice;
+	command.generation = playing.generation;
+	command.data = &data;
+	command.loop = (loop_or_once == Loop);
+	command.vector = position;
+	command.value = volume;
+	submit(command);
+	return playing;
+}
+
+void set_steal_policy(StealPolicy policy) {
+	steal_policy = policy;
 }
 
 
 //------------------
 
 void PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	lock();
-	position.set(new_position, ramp);
-	unlock();
+	if (voice == -1U) return;
+	Command command;
+	command.type = Command::SetPosition;
+	command.voice = voice;
+	command.generation = generation;
+	command.vector = new_position;
+	command.ramp = ramp;
+	submit(command);
 }
 
 void PlayingSample::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	if (voice == -1U) return;
+	Command command;
+	command.type = Command::SetVolume;
+	command.voice = voice;
+	command.generation = generation;
+	command.value = new_volume;
+	command.ramp = ramp;
+	submit(command);
 }
 
 void PlayingSample::stop(float ramp) {
-	lock();
-	if (!stopped) {
-		stopped = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	unlock();
+	if (voice == -1U) return;
+	Command command;
+	command.type = Command::Stop;
+	command.voice = voice;
+	command.generation = generation;
+	command.ramp = ramp;
+	submit(command);
 }
 
 //------------------
 
 void Listener::set_position(glm::vec3 const &new_position, float ramp) {
-	lock();
-	position.set(new_position, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetListenerPosition;
+	command.vector = new_position;
+	command.ramp = ramp;
+	submit(command);
 }
 
 void Listener::set_right(glm::vec3 const &new_right, float ramp) {
-	lock();
+	Command command;
+	command.type = Command::SetListenerRight;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.vector = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.vector = glm::normalize(new_right);
 	}
-	unlock();
+	command.ramp = ramp;
+	submit(command);
 }
 
 //------------------
@@ -316,6 +545,15 @@ void init() {
 	}
 }
 
+void init_offline() {
+	offline = true;
+}
+
+void mix_offline(float *out) {
+	assert(offline && !device);
+	mix_audio(nullptr, reinterpret_cast< Uint8 * >(out), int(MixSamples * sizeof(LR)));
+}
+
 void lock() {
 	if (device) SDL_LockAudioDevice(device);
 }
@@ -325,17 +563,18 @@ void unlock() {
 }
 
 void stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	submit(command);
 }
 
 void set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetMasterVolume;
+	command.value = new_volume;
+	command.ramp = ramp;
+	submit(command);
 }
 
 } //namespace Sound
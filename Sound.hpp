@@ -11,6 +11,8 @@ namespace Sound {
 
 struct PlayingSample;
 
+constexpr const uint32_t MaxVoices = 256; //samples that can play at once (see StealPolicy for what happens beyond that)
+
 enum LoopOrOnce {
 	Once,
 	Loop
@@ -22,10 +24,13 @@ struct Sample {
 	// will warn and downmix to mono if file is stereo
 	// will warn and perform not-very-good interpolation if file is not Sound::AudioRate
 	Sample(std::string const &filename);
+	//use mono samples at Sound::AudioRate directly (e.g., generated ones):
+	Sample(std::vector< float > const &data);
 
 	//start playing an instance of this sample at a given initial position and volume:
 	// the returned 'PlayingSample' handle can be used to change position, fade volume, or cancel playback.
-	std::shared_ptr< PlayingSample > play(
+	// (the sample must stay loaded while it plays)
+	PlayingSample play(
 		glm::vec3 const &position,
 		float volume = 1.0f,
 		LoopOrOnce loop_or_once = Once
@@ -54,6 +59,9 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
+//handle to a sample playing in one of the mixer's MaxVoices voices:
+// handles are small values that can be copied freely; once the sample finishes (or its voice is
+// stolen for another sample) the voice's generation changes, and calls through old handles do nothing.
 struct PlayingSample {
 	//change the position or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
@@ -62,17 +70,17 @@ struct PlayingSample {
 	void stop(float ramp = 1.0f / 60.0f);
 
 	//internals:
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f);
-	Ramp< float > volume = Ramp< float >(1.0f);
+	uint32_t voice = -1U; //index of voice (-1U if no voice could be had -- see StealPolicy)
+	uint32_t generation = 0; //generation of voice when this sample started
+};
 
-	PlayingSample(Sample const *sample_, glm::vec3 const &position_, float volume_, bool loop_)
-		: data(sample_->data), loop(loop_), position(position_), volume(volume_) { }
+//what Sample::play does when all voices are busy:
+enum StealPolicy {
+	StealOldest, //take the voice that started longest ago
+	StealQuietest, //take the voice that was quietest in the last mixed block
+	StealNone, //don't play the new sample (play returns a handle that does nothing)
 };
+void set_steal_policy(StealPolicy policy); //(default: StealOldest)
 
 struct Listener {
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
@@ -91,9 +99,19 @@ constexpr const uint32_t MixSamples = 1024; //samples to mix at once; SDL requir
 
 void init(); //should call Sound::init() from main.cpp before using any member functions
 
+//mixing without an audio device (for tests, benchmarks, or rendering to a file):
+// call init_offline() instead of init(); each mix_offline() then applies queued commands and mixes the next
+// MixSamples stereo samples (interleaved left/right floats) into 'out', just as the audio callback would.
+// (call mix_offline() from the same thread as the play/set_*/stop/... functions)
+void init_offline();
+void mix_offline(float *out);
+
+//the play/set_*/stop/... functions don't wait for the audio callback: they queue commands,
+// which the callback applies at the start of the next block it mixes.
+// (the queue has one producer, so call these functions from one thread only -- e.g., the main thread)
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly
+// you shouldn't need to call these unless your code is reading or modifying values directly
 void lock();
 void unlock();
 
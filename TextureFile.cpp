@@ -0,0 +1,80 @@
+#include "TextureFile.hpp"
+
+#include "bc1.hpp"
+#include "gl_errors.hpp"
+#include "startup_timing.hpp"
+
+#include <SDL.h>
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+uint32_t TextureFile::level_size(Format format, uint32_t width, uint32_t height) {
+	if (format == FormatBC1) return bc1_size(width, height);
+	else return width * height * 4;
+}
+
+TextureFile::TextureFile(std::string const &filename) : file(filename) {
+	auto headers = file.read< Header >("tex0");
+	if (headers.size() != 1) {
+		throw std::runtime_error("Expected exactly one texture header in '" + filename + "'.");
+	}
+	header = headers[0];
+	levels = file.read< Level >("levl");
+	data = file.read< uint8_t >("data");
+	if (!file.at_end()) {
+		throw std::runtime_error("Trailing chunks in texture file '" + filename + "'.");
+	}
+
+	if (header.format != FormatRGBA8 && header.format != FormatBC1) {
+		throw std::runtime_error("Unknown texture format in '" + filename + "'.");
+	}
+	if (header.levels == 0 || header.levels != levels.size()) {
+		throw std::runtime_error("Level count mismatch in '" + filename + "'.");
+	}
+	uint32_t width = header.width;
+	uint32_t height = header.height;
+	for (auto const &level : levels) {
+		if (level.width != width || level.height != height
+		 || level.size != level_size(Format(header.format), width, height)
+		 || uint64_t(level.offset) + level.size > data.size()) {
+			throw std::runtime_error("Bad mip level in '" + filename + "'.");
+		}
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+}
+
+GLuint TextureFile::upload() const {
+	StartupTimer timer("TextureFile::upload " + file.filename);
+
+	//BC1 isn't core OpenGL, though essentially every desktop GPU has it:
+	static bool const have_s3tc = SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc");
+
+	GLuint tex = 0;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	for (uint32_t i = 0; i < levels.size(); ++i) {
+		Level const &level = levels[i];
+		uint8_t const *level_data = data.data() + level.offset;
+		if (header.format == FormatBC1 && have_s3tc) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, level.width, level.height, 0, level.size, level_data);
+		} else if (header.format == FormatBC1) {
+			std::vector< glm::u8vec4 > pixels;
+			decompress_bc1(level.width, level.height, level_data, &pixels);
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGB8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level_data);
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(levels.size()) - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	GL_ERRORS();
+
+	return tex;
+}
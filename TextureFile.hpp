@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ChunkFile.hpp"
+#include "GL.hpp"
+
+#include <string>
+#include <cstdint>
+
+//TextureFile reads textures prepared by the 'texconv' tool, which stores every mip level already in
+// the format the GPU samples from (so loading is just mapping the file and handing levels to OpenGL):
+//  "tex0" Header
+//  "levl" Level[header.levels] (largest first)
+//  "data" level contents (referred to by Level::offset + Level::size)
+//Rows are stored bottom-to-top (like load_png with LowerLeftOrigin).
+struct TextureFile {
+	enum Format : uint32_t {
+		FormatRGBA8 = 0, //4 bytes per pixel
+		FormatBC1 = 1, //4x4 blocks, 8 bytes per block (see bc1.hpp)
+	};
+
+	struct Header {
+		uint32_t format = FormatRGBA8;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t levels = 0;
+	};
+	static_assert(sizeof(Header) == 16, "Header is packed.");
+
+	struct Level {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t offset = 0;
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(Level) == 16, "Level is packed.");
+
+	//bytes needed for one level in a given format:
+	static uint32_t level_size(Format format, uint32_t width, uint32_t height);
+
+	//map and check the file (fine to do on a worker thread); throws on failure:
+	TextureFile(std::string const &filename);
+
+	//make a mipmapped, repeating texture (main thread only):
+	// (BC1 data is decompressed if the GPU doesn't support it)
+	GLuint upload() const;
+
+	ChunkFile file;
+	Header header;
+	ChunkFile::Span< Level > levels;
+	ChunkFile::Span< uint8_t > data;
+};
@@ -1,29 +1,77 @@
 #include "WalkMesh.hpp"
 
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "jobs.hpp"
 
+#define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/norm.hpp>
 
 #include <iostream>
-#include <fstream>
 #include <algorithm>
 #include <string>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+//walk batches of points four at a time with SSE where it is available (always, on x86-64):
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define WALKMESH_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_) {
+	std::shared_ptr< Owned > data = std::make_shared< Owned >();
+	data->vertices = vertices_;
+	data->normals = normals_;
+	data->triangles = triangles_;
+	data->adjacency.resize(3 * data->triangles.size());
+
+	vertices = ChunkFile::Span< glm::vec3 >(data->vertices.data(), data->vertices.data() + data->vertices.size());
+	normals = ChunkFile::Span< glm::vec3 >(data->normals.data(), data->normals.data() + data->normals.size());
+	triangles = ChunkFile::Span< glm::uvec3 >(data->triangles.data(), data->triangles.data() + data->triangles.size());
+	compute_adjacency(triangles, data->adjacency.data());
+	adjacency = ChunkFile::Span< uint32_t >(data->adjacency.data(), data->adjacency.data() + data->adjacency.size());
+	owned = data;
+
+	check_normals();
+	build_bvh();
+}
 
-WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_)
-	: vertices(vertices_), normals(normals_), triangles(triangles_) {
+WalkMesh::WalkMesh(ChunkFile::Span< glm::vec3 > const &vertices_, ChunkFile::Span< glm::vec3 > const &normals_, ChunkFile::Span< glm::uvec3 > const &triangles_, ChunkFile::Span< uint32_t > const &adjacency_)
+	: vertices(vertices_), normals(normals_), triangles(triangles_), adjacency(adjacency_) {
+	assert(adjacency.size() == 3 * triangles.size());
 
-	//construct next_vertex map (maps each edge to the next vertex in the triangle):
-	next_vertex.reserve(triangles.size()*3);
-	auto do_next = [this](uint32_t a, uint32_t b, uint32_t c) {
-		auto ret = next_vertex.insert(std::make_pair(glm::uvec2(a,b), c));
-		assert(ret.second);
-	};
-	for (auto const &tri : triangles) {
-		do_next(tri.x, tri.y, tri.z);
-		do_next(tri.y, tri.z, tri.x);
-		do_next(tri.z, tri.x, tri.y);
+	check_normals();
+	build_bvh();
+}
+
+void WalkMesh::compute_adjacency(ChunkFile::Span< glm::uvec3 > const &triangles, uint32_t *adjacency) {
+	//sort edges, so that each edge's twin can be found with a binary search:
+	assert(triangles.size() < (1u << 30)); //(so triangle indices fit in adjacency entries)
+	std::vector< std::pair< uint64_t, uint32_t > > edges; //(from << 32 | to, 3*t+k)
+	edges.reserve(triangles.size() * 3);
+	for (uint32_t t = 0; t < triangles.size(); ++t) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint64_t from = triangles[t][k];
+			uint64_t to = triangles[t][(k+1)%3];
+			edges.emplace_back((from << 32) | to, 3*t+k);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::fill(adjacency, adjacency + edges.size(), -1U);
+	for (uint32_t i = 0; i < edges.size(); ++i) {
+		assert(i == 0 || edges[i-1].first != edges[i].first); //each edge should only appear once in each direction
+		uint64_t twin = (edges[i].first << 32) | (edges[i].first >> 32);
+		auto f = std::lower_bound(edges.begin(), edges.end(), std::make_pair(twin, 0u));
+		if (f != edges.end() && f->first == twin) {
+			adjacency[edges[i].second] = ((f->second / 3) << 2) | (f->second % 3);
+		}
 	}
+}
 
+void WalkMesh::check_normals() const {
+#ifndef NDEBUG
 	//DEBUG: are vertex normals consistent with geometric normals?
 	for (auto const &tri : triangles) {
 		glm::vec3 const &a = vertices[tri.x];
@@ -37,198 +85,581 @@ WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::
 
 		assert(da > 0.1f && db > 0.1f && dc > 0.1f);
 	}
+#endif
 }
 
-WalkMesh::WalkPoint WalkMesh::start(glm::vec3 const &world_point) const {
-	WalkPoint closest;
-	float closest_dis2 = std::numeric_limits< float >::infinity();
-	for (auto const &tri : triangles) {
-		glm::vec3 const &a = vertices[tri.x];
-		glm::vec3 const &b = vertices[tri.y];
-		glm::vec3 const &c = vertices[tri.z];
+void WalkMesh::closest_on_triangle(uint32_t ti, glm::vec3 const &world_point, WalkPoint *wp_, float *dis2_) const {
+	WalkPoint &closest = *wp_;
+	float &closest_dis2 = *dis2_;
+	closest = WalkPoint();
+	closest_dis2 = std::numeric_limits< float >::infinity();
+
+	glm::uvec3 const &tri = triangles[ti];
+	glm::vec3 const &a = vertices[tri.x];
+	glm::vec3 const &b = vertices[tri.y];
+	glm::vec3 const &c = vertices[tri.z];
+
+	//figure out barycentric coordinates for point:
+	//project to plane of triangle:
+	// (the plane through 'a' -- projecting to the parallel plane through the origin gives the same barycentric
+	//  coordinates, but not the right distance)
+	glm::vec3 out = glm::cross(b-a, c-a);
+	glm::vec3 pt = world_point - out * (glm::dot(out, world_point - a) / glm::dot(out, out));
+
+	//figure out barycentric coordinates using signed triangle areas:
+	glm::vec3 coords = glm::vec3(
+		glm::dot(out, glm::cross(c-b, pt-b)),
+		glm::dot(out, glm::cross(a-c, pt-c)),
+		glm::dot(out, glm::cross(b-a, pt-a))
+	) / glm::dot(out, glm::cross(b-a, c-a));
+
+	//is point inside triangle?
+	if (coords.x >= 0.0f && coords.y >= 0.0f && coords.z >= 0.0f) {
+		//yes, point is inside triangle.
+		closest_dis2 = glm::length2(world_point - pt);
+		closest.triangle = tri;
+		closest.weights = coords;
+		closest.face = ti;
+	} else {
+		//check triangle vertices and edges:
+		auto check_edge = [&world_point, &closest, &closest_dis2, ti, this](uint32_t ai, uint32_t bi, uint32_t ci) {
+			glm::vec3 const &a = vertices[ai];
+			glm::vec3 const &b = vertices[bi];
+
+			//find closest point on line segment ab:
+			float along = glm::dot(world_point-a, b-a);
+			float max = glm::dot(b-a, b-a);
+			glm::vec3 pt;
+			glm::vec3 coords;
+			if (along < 0.0f) {
+				pt = a;
+				coords = glm::vec3(1.0f, 0.0f, 0.0f);
+			} else if (along > max) {
+				pt = b;
+				coords = glm::vec3(0.0f, 1.0f, 0.0f);
+			} else {
+				float amt = along / max;
+				pt = glm::mix(a, b, amt);
+				coords = glm::vec3(1.0f - amt, amt, 0.0f);
+			}
 
-		//figure out barycentric coordinates for point:
-		//project to plane of triangle:
-		glm::vec3 out = glm::cross(b-a, c-a);
-		glm::vec3 pt = world_point - out * (glm::dot(out, world_point) / glm::dot(out, out));
-
-		//figure out barycentric coordinates using signed triangle areas:
-		glm::vec3 coords = glm::vec3(
-			glm::dot(out, glm::cross(c-b, pt-b)),
-			glm::dot(out, glm::cross(a-c, pt-c)),
-			glm::dot(out, glm::cross(b-a, pt-a))
-		) / glm::dot(out, glm::cross(b-a, c-a));
-
-		//is point inside triangle?
-		if (coords.x >= 0.0f && coords.y >= 0.0f && coords.z >= 0.0f) {
-			//yes, point is inside triangle.
 			float dis2 = glm::length2(world_point - pt);
 			if (dis2 < closest_dis2) {
 				closest_dis2 = dis2;
-				closest.triangle = tri;
+				closest.triangle = glm::uvec3(ai, bi, ci);
 				closest.weights = coords;
+				closest.face = ti;
 			}
-		} else {
-			//check triangle vertices and edges:
-			auto check_edge = [&world_point, &closest, &closest_dis2, this](uint32_t ai, uint32_t bi, uint32_t ci) {
-				glm::vec3 const &a = vertices[ai];
-				glm::vec3 const &b = vertices[bi];
-
-				//find closest point on line segment ab:
-				float along = glm::dot(world_point-a, b-a);
-				float max = glm::dot(b-a, b-a);
-				glm::vec3 pt;
-				glm::vec3 coords;
-				if (along < 0.0f) {
-					pt = a;
-					coords = glm::vec3(1.0f, 0.0f, 0.0f);
-				} else if (along > max) {
-					pt = b;
-					coords = glm::vec3(0.0f, 1.0f, 0.0f);
-				} else {
-					float amt = along / max;
-					pt = glm::mix(a, b, amt);
-					coords = glm::vec3(1.0f - amt, amt, 0.0f);
-				}
+		};
+		check_edge(tri.x, tri.y, tri.z);
+		check_edge(tri.y, tri.z, tri.x);
+		check_edge(tri.z, tri.x, tri.y);
+	}
+}
+
+WalkMesh::WalkPoint WalkMesh::start_brute_force(glm::vec3 const &world_point) const {
+	WalkPoint closest;
+	float closest_dis2 = std::numeric_limits< float >::infinity();
+	for (uint32_t ti = 0; ti < triangles.size(); ++ti) {
+		WalkPoint wp;
+		float dis2;
+		closest_on_triangle(ti, world_point, &wp, &dis2);
+		if (dis2 < closest_dis2) {
+			closest_dis2 = dis2;
+			closest = wp;
+		}
+	}
+	return closest;
+}
 
-				float dis2 = glm::length2(world_point - pt);
-				if (dis2 < closest_dis2) {
+WalkMesh::WalkPoint WalkMesh::start(glm::vec3 const &world_point) const {
+	//NOTE: this must give exactly the same result as start_brute_force(), which keeps the
+	// first (lowest-index) triangle among those at the minimum distance.
+	WalkPoint closest;
+	float closest_dis2 = std::numeric_limits< float >::infinity();
+	uint32_t closest_ti = -1U;
+	if (bvh.empty()) return closest;
+
+	//squared distance from world_point to a node's box (a lower bound for any triangle in it):
+	auto box_dis2 = [&world_point](BVHNode const &node) {
+		glm::vec3 d = glm::max(glm::vec3(0.0f), glm::max(node.min - world_point, world_point - node.max));
+		return glm::dot(d, d);
+	};
+
+	//depth-first, nearer child first, skipping nodes that can't contain anything closer:
+	std::vector< std::pair< float, uint32_t > > stack; //(box distance, node)
+	stack.reserve(64);
+	stack.emplace_back(box_dis2(bvh[0]), 0);
+	while (!stack.empty()) {
+		float node_dis2 = stack.back().first;
+		BVHNode const &node = bvh[stack.back().second];
+		stack.pop_back();
+		//(nodes at exactly the current distance might still hold a lower-index triangle, so aren't skipped)
+		if (node_dis2 > closest_dis2) continue;
+
+		if (node.count != 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				uint32_t ti = bvh_triangles[i];
+				WalkPoint wp;
+				float dis2;
+				closest_on_triangle(ti, world_point, &wp, &dis2);
+				if (dis2 < closest_dis2 || (dis2 == closest_dis2 && ti < closest_ti)) {
 					closest_dis2 = dis2;
-					closest.triangle = glm::uvec3(ai, bi, ci);
-					closest.weights = coords;
+					closest_ti = ti;
+					closest = wp;
 				}
-			};
-			check_edge(tri.x, tri.y, tri.z);
-			check_edge(tri.y, tri.z, tri.x);
-			check_edge(tri.z, tri.x, tri.y);
+			}
+		} else {
+			float dis2_a = box_dis2(bvh[node.first]);
+			float dis2_b = box_dis2(bvh[node.first + 1]);
+			//(push the farther child first, so the nearer one is visited first)
+			if (dis2_a < dis2_b) {
+				stack.emplace_back(dis2_b, node.first + 1);
+				stack.emplace_back(dis2_a, node.first);
+			} else {
+				stack.emplace_back(dis2_a, node.first);
+				stack.emplace_back(dis2_b, node.first + 1);
+			}
 		}
 	}
 	return closest;
 }
 
-void WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const {
+void WalkMesh::build_bvh() {
+	bvh.clear();
+	bvh_triangles.clear();
+	if (triangles.empty()) return;
+
+	//closest_on_triangle can land a little outside a triangle's bounds due to rounding, so boxes are padded
+	// by an amount well above that error (which scales with the size of the coordinates involved):
+	// (only looks at vertices used by triangles, since 'vertices' may be shared with other meshes)
+	float scale = 0.0f;
+	for (auto const &tri : triangles) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			glm::vec3 const &v = vertices[tri[k]];
+			scale = std::max(scale, std::max(std::abs(v.x), std::max(std::abs(v.y), std::abs(v.z))));
+		}
+	}
+	glm::vec3 pad = glm::vec3(scale * 1e-4f + 1e-6f);
+
+	std::vector< glm::vec3 > centers;
+	centers.reserve(triangles.size());
+	bvh_triangles.reserve(triangles.size());
+	for (uint32_t ti = 0; ti < triangles.size(); ++ti) {
+		glm::uvec3 const &tri = triangles[ti];
+		centers.emplace_back((vertices[tri.x] + vertices[tri.y] + vertices[tri.z]) / 3.0f);
+		bvh_triangles.emplace_back(ti);
+	}
+
+	const uint32_t LeafSize = 4;
+	bvh.reserve(2 * (triangles.size() / LeafSize + 1));
+
+	//build top-down, splitting at the median along the longest axis of the triangle centers:
+	std::vector< uint32_t > todo; //nodes still to be split or made into leaves
+	bvh.emplace_back(BVHNode{glm::vec3(0.0f), glm::vec3(0.0f), 0, uint32_t(triangles.size())});
+	todo.emplace_back(0);
+	while (!todo.empty()) {
+		uint32_t ni = todo.back();
+		todo.pop_back();
+		uint32_t first = bvh[ni].first;
+		uint32_t count = bvh[ni].count;
+
+		glm::vec3 min = glm::vec3(std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		glm::vec3 center_min = min, center_max = max;
+		for (uint32_t i = first; i < first + count; ++i) {
+			glm::uvec3 const &tri = triangles[bvh_triangles[i]];
+			for (uint32_t v : {tri.x, tri.y, tri.z}) {
+				min = glm::min(min, vertices[v]);
+				max = glm::max(max, vertices[v]);
+			}
+			center_min = glm::min(center_min, centers[bvh_triangles[i]]);
+			center_max = glm::max(center_max, centers[bvh_triangles[i]]);
+		}
+		bvh[ni].min = min - pad;
+		bvh[ni].max = max + pad;
+
+		if (count <= LeafSize) continue; //leaf
+
+		glm::vec3 extent = center_max - center_min;
+		uint32_t axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		uint32_t mid = first + count / 2;
+		std::nth_element(bvh_triangles.begin() + first, bvh_triangles.begin() + mid, bvh_triangles.begin() + first + count,
+			[&centers, axis](uint32_t a, uint32_t b) {
+				return centers[a][axis] < centers[b][axis];
+			});
+
+		uint32_t child = uint32_t(bvh.size());
+		bvh.emplace_back(BVHNode{glm::vec3(0.0f), glm::vec3(0.0f), first, mid - first});
+		bvh.emplace_back(BVHNode{glm::vec3(0.0f), glm::vec3(0.0f), mid, first + count - mid});
+		bvh[ni].first = child;
+		bvh[ni].count = 0;
+		todo.emplace_back(child);
+		todo.emplace_back(child + 1);
+	}
+}
+
+namespace {
+	//solid edges remembered per step (more than two only meet at vertices where many walls come together):
+	constexpr uint32_t MaxWalkConstraints = 4;
+
+	//component of 'v' in the plane of a triangle, perpendicular to the edge a-b, pointing toward 'other':
+	// (not normalized -- callers divide by its squared length where needed)
+	inline glm::vec3 edge_inward(glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &other) {
+		glm::vec3 along = b - a;
+		glm::vec3 in = other - a;
+		return in - along * (glm::dot(along, in) / glm::dot(along, along));
+	}
+
+	//remove the part of 'v' pointing against 'in':
+	inline glm::vec3 slide_along(glm::vec3 const &v, glm::vec3 const &in) {
+		float d = glm::dot(in, v);
+		if (d < 0.0f) return v - in * (d / glm::dot(in, in));
+		else return v;
+	}
+
+	//barycentric coordinates of step 'r' projected to the plane of triangle 'a','b','c' (arrays are x,y,z):
+	// F is float for one point, or Lanes for four points at once. Both walk()s use this, so each point's coordinates come from
+	// the same operations in the same order either way (the Jamfile turns off fused multiply-add so the compiler keeps it so).
+	template< typename F >
+	inline void step_coords(F const (&a)[3], F const (&b)[3], F const (&c)[3], F const (&r)[3], F (&coords)[3]) {
+		F ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		F ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		F bc[3] = { c[0] - b[0], c[1] - b[1], c[2] - b[2] };
+		F ca[3] = { a[0] - c[0], a[1] - c[1], a[2] - c[2] };
+
+		//triangle normal (not normalized):
+		F out[3] = {
+			ab[1] * ac[2] - ab[2] * ac[1],
+			ab[2] * ac[0] - ab[0] * ac[2],
+			ab[0] * ac[1] - ab[1] * ac[0]
+		};
+		F out2 = out[0] * out[0] + out[1] * out[1] + out[2] * out[2];
+
+		//project to plane of triangle:
+		F along = (out[0] * r[0] + out[1] * r[1] + out[2] * r[2]) / out2;
+		F pt[3] = { r[0] - out[0] * along, r[1] - out[1] * along, r[2] - out[2] * along };
+
+		//each coordinate is the (signed) area 'pt' makes with the opposite edge, relative to the area of the triangle:
+		auto coord = [&out, &out2, &pt](F const (&e)[3]) {
+			F x = e[1] * pt[2] - e[2] * pt[1];
+			F y = e[2] * pt[0] - e[0] * pt[2];
+			F z = e[0] * pt[1] - e[1] * pt[0];
+			return (out[0] * x + out[1] * y + out[2] * z) / out2;
+		};
+		coords[0] = coord(bc);
+		coords[1] = coord(ca);
+		coords[2] = coord(ab);
+	}
+
+	//keep weights a valid barycentric point after rounding (same operations as the SSE version in the batched walk()):
+	inline void fix_weights(glm::vec3 &w) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (w[i] < 0.0f) w[i] = 0.0f;
+		}
+		float sum = w.x + w.y + w.z;
+		w = glm::vec3(w.x / sum, w.y / sum, w.z / sum);
+	}
+
+#ifdef WALKMESH_USE_SSE
+	//one float per point, for four points, for step_coords():
+	struct Lanes {
+		__m128 v;
+		Lanes() = default;
+		Lanes(__m128 v_) : v(v_) { }
+	};
+	inline Lanes operator+(Lanes const &a, Lanes const &b) { return _mm_add_ps(a.v, b.v); }
+	inline Lanes operator-(Lanes const &a, Lanes const &b) { return _mm_sub_ps(a.v, b.v); }
+	inline Lanes operator*(Lanes const &a, Lanes const &b) { return _mm_mul_ps(a.v, b.v); }
+	inline Lanes operator/(Lanes const &a, Lanes const &b) { return _mm_div_ps(a.v, b.v); }
+#endif
+}
+
+uint32_t WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const {
+	return walk(wp, step, nullptr);
+}
+
+uint32_t WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step, glm::vec3 const *step_coords_) const {
 
 	glm::vec3 remain = step;
 
-	uint32_t iter = 0;
+	//solid edges (vertex, vertex, other vertex of their triangle) that 'remain' has been slid along:
+	// (these stay in force while the point is on the edge -- possibly over several triangles, when at a vertex)
+	glm::uvec3 constraints[MaxWalkConstraints];
+	uint32_t constraint_count = 0;
+	auto on_edge = [&wp](glm::uvec3 const &e) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (wp.weights[i] != 0.0f && wp.triangle[i] != e.x && wp.triangle[i] != e.y) return false;
+		}
+		return true;
+	};
+	auto inward = [this](glm::uvec3 const &e) {
+		return edge_inward(vertices[e.x], vertices[e.y], vertices[e.z]);
+	};
+
+	//weight that is zero because its edge was just crossed to get into this triangle, or -1U:
+	// ('remain' was rotated to point into this triangle, so -- just as for solid edges -- it must not cross back)
+	uint32_t entered = -1U;
+
+	uint32_t crossings = 0;
 	while (remain != glm::vec3(0.0f)) {
-		if (iter > 10) {
-			std::cerr << "WARNING: Couldn't resolve step in ten iterations, discarding the rest." << std::endl;
+		if (crossings >= MaxWalkCrossings) {
+			std::cerr << "WARNING: Couldn't resolve step in " << MaxWalkCrossings << " edge crossings, discarding the rest." << std::endl;
 			break;
 		}
-		iter += 1;
 
 		glm::vec3 remain_coords;
-		{ //project 'remain' to current triangle:
+		if (step_coords_) { //(already projected by the caller)
+			remain_coords = *step_coords_;
+			step_coords_ = nullptr;
+		} else { //project 'remain' to current triangle and figure out its barycentric coordinates:
 			glm::vec3 const &a = vertices[wp.triangle.x];
 			glm::vec3 const &b = vertices[wp.triangle.y];
 			glm::vec3 const &c = vertices[wp.triangle.z];
 
-			//project to plane of triangle:
-			glm::vec3 out = glm::cross(b-a, c-a);
-			glm::vec3 pt = remain - out * (glm::dot(out, remain) / glm::dot(out, out));
-
-			assert(pt == pt); //pt isn't NaN, right?
-
-			//figure out barycentric coordinates for remain:
-			glm::vec3 coords = glm::vec3(
-				glm::dot(out, glm::cross(c-b, pt)),
-				glm::dot(out, glm::cross(a-c, pt)),
-				glm::dot(out, glm::cross(b-a, pt))
-			) / glm::dot(out, glm::cross(b-a, c-a));
+			float fa[3] = { a.x, a.y, a.z };
+			float fb[3] = { b.x, b.y, b.z };
+			float fc[3] = { c.x, c.y, c.z };
+			float fr[3] = { remain.x, remain.y, remain.z };
+			float coords[3];
+			step_coords(fa, fb, fc, fr, coords);
 
-			assert(coords.x == coords.x && coords.y == coords.y && coords.z == coords.z); //riiiight?
-
-			remain_coords = coords;
-
-			assert(remain_coords.x == remain_coords.x); //remain_coords shouldn't be NaN
+			remain_coords = glm::vec3(coords[0], coords[1], coords[2]);
+		}
+		assert(remain_coords.x == remain_coords.x && remain_coords.y == remain_coords.y && remain_coords.z == remain_coords.z); //riiiight?
+
+		//'remain' was already turned away from the edges in 'constraints' (and the entered edge);
+		// don't let rounding push it back through them:
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (wp.weights[i] != 0.0f || remain_coords[i] >= 0.0f) continue;
+			bool clamp = (i == entered);
+			uint32_t a = wp.triangle[(i+1)%3], b = wp.triangle[(i+2)%3];
+			for (uint32_t c = 0; c < constraint_count; ++c) {
+				if ((constraints[c].x == a && constraints[c].y == b) || (constraints[c].x == b && constraints[c].y == a)) clamp = true;
+			}
+			if (clamp) remain_coords[i] = 0.0f;
 		}
 
+		//figure out when (if ever) and where an edge is crossed:
 		float t = 1.0f;
-		glm::uvec2 edge = glm::uvec2(-1U); uint32_t other = -1U;
-		glm::vec2 edge_coords = glm::vec2(std::numeric_limits< float >::quiet_NaN());
-		{ //figure out when (if ever) and where an edge is crossed:
-			#define TEST_COORD( C, A, B ) \
-				if (remain_coords.C < 0.0f) { \
-					float test = std::max(0.0f, -wp.weights.C / remain_coords.C); \
-					if (test < t) { \
-						t = test; \
-						edge = glm::uvec2(wp.triangle.A, wp.triangle.B); other = wp.triangle.C; \
-						edge_coords = glm::vec2(t * remain_coords.A + wp.weights.A, t * remain_coords.B + wp.weights.B); \
-					} \
+		uint32_t hit = -1U; //weight that reaches zero (the crossed edge is opposite that vertex)
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (remain_coords[i] < 0.0f) {
+				float test = std::max(0.0f, -wp.weights[i] / remain_coords[i]);
+				if (test < t) {
+					t = test;
+					hit = i;
 				}
-			TEST_COORD( x, y, z );
-			TEST_COORD( y, z, x );
-			TEST_COORD( z, x, y );
-			#undef TEST_COORD
+			}
 		}
 		assert(t == t); //makes sure t isn't NaN
 
 		//didn't hit an edge -- move and done.
-		if (t >= 1.0f) {
+		if (hit == -1U) {
 			wp.weights += remain_coords;
-			remain_coords = glm::vec3(0.0f);
 			break;
 		}
 		assert(t >= 0.0f);
-		assert(edge_coords == edge_coords); //edge_coords isn't NaN
+		crossings += 1;
 
-		//consume the first 't' of step:
+		//consume the first 't' of step, landing exactly on the edge:
 		wp.weights += remain_coords * t;
+		wp.weights[hit] = 0.0f;
 		remain *= (1.0f - t);
 
-		//is edge solid?
-		auto f = next_vertex.find(glm::uvec2(edge.y, edge.x));
-		if (f == next_vertex.end()) {
-			//if yes, move remain to point (slightly) inward:
-			glm::vec3 along = glm::normalize(vertices[edge.y] - vertices[edge.x]);
-			glm::vec3 in = vertices[other] - vertices[edge.x];
-			in = glm::normalize(in - along * glm::dot(along, in));
+		uint32_t ia = (hit + 1) % 3, ib = (hit + 2) % 3;
+		glm::uvec2 edge = glm::uvec2(wp.triangle[ia], wp.triangle[ib]);
+		uint32_t other = wp.triangle[hit];
 
-			float d = glm::dot(in, remain);
+		//is edge solid?
+		glm::uvec3 const &tri = triangles[wp.face];
+		uint32_t slot = (tri.x == edge.x ? 0 : (tri.y == edge.x ? 1 : 2)); //(edge 'slot' of 'tri' starts at edge.x)
+		assert(tri[slot] == edge.x && tri[(slot+1)%3] == edge.y);
+		uint32_t across = adjacency[3*wp.face+slot];
+		if (across == -1U) {
+			//if yes, slide: remove the part of 'remain' that points out through the edge...
+			glm::uvec3 solid = glm::uvec3(edge.x, edge.y, other);
+			glm::vec3 in = inward(solid);
+			glm::vec3 slide = slide_along(remain, in);
+
+			//...while still respecting the other solid edges the point is on (i.e., when it is in a corner):
+			uint32_t kept = 0;
+			bool cornered = false;
+			for (uint32_t c = 0; c < constraint_count; ++c) {
+				if (!on_edge(constraints[c])) continue; //(point has moved off this edge, so it no longer applies)
+				constraints[kept++] = constraints[c];
+				glm::vec3 in2 = inward(constraints[c]);
+				if (glm::dot(in2, slide) >= 0.0f) continue;
+				//sliding along the new edge goes out through this one; try sliding along this one instead:
+				glm::vec3 slide2 = slide_along(remain, in2);
+				if (glm::dot(in, slide2) >= 0.0f) {
+					slide = slide2;
+				} else {
+					//both constraints hold, and the only direction left in their intersection is no motion at all:
+					cornered = true;
+				}
+			}
+			constraint_count = kept;
+			if (cornered) break;
 
-			remain = remain + in * (0.01f - d);
+			if (constraint_count == MaxWalkConstraints) {
+				std::copy(constraints + 1, constraints + constraint_count, constraints);
+				constraint_count -= 1;
+			}
+			constraints[constraint_count++] = solid;
 
-			//NOTE: this probably results in an infinite loop when walking into a corner.
+			remain = slide;
+			entered = -1U; //(sliding may legitimately run back across the entered edge)
 		} else {
 			//if no, move to new triangle:
-			assert(f->second != other);
+			uint32_t next_face = across >> 2;
+			uint32_t next_slot = across & 3; //(edge 'next_slot' of the new triangle runs from edge.y to edge.x)
+			uint32_t next_other = triangles[next_face][(next_slot+2)%3];
+			assert(next_other != other);
 
 			//update triangle and weights:
-			wp.triangle = glm::uvec3(edge.y, edge.x, f->second);
-			wp.weights = glm::vec3(edge_coords.y, edge_coords.x, 0.0f);
+			glm::vec3 edge_weights = wp.weights;
+			wp.face = next_face;
+			wp.triangle = glm::uvec3(edge.y, edge.x, next_other);
+			wp.weights = glm::vec3(edge_weights[ib], edge_weights[ia], 0.0f);
+			entered = 2;
 
 			//rotate 'remain' around edge:
-			glm::vec3 along = glm::normalize(vertices[edge.y] - vertices[edge.x]);
-			glm::vec3 to_old_other = vertices[other] - vertices[edge.x];
-			to_old_other = glm::normalize(to_old_other - along * glm::dot(along, to_old_other));
+			// (only the part perpendicular to the edge changes direction, from the old triangle's plane to the new one's)
+			glm::vec3 to_old_other = edge_inward(vertices[edge.x], vertices[edge.y], vertices[other]);
+			glm::vec3 to_new_other = edge_inward(vertices[edge.x], vertices[edge.y], vertices[next_other]);
 
-			glm::vec3 to_new_other = vertices[f->second] - vertices[edge.y];
-			to_new_other = glm::normalize(to_new_other - along * glm::dot(along, to_new_other));
+			float old_len = std::sqrt(glm::dot(to_old_other, to_old_other));
+			float new_len = std::sqrt(glm::dot(to_new_other, to_new_other));
 
-			float d = glm::dot(remain, -to_old_other); //amount of 'remain' sticking out of old triangle
+			float d = -glm::dot(remain, to_old_other) / old_len; //amount of 'remain' sticking out of old triangle
 
-			remain -= d * -to_old_other; //remove 'remain' sticking out in plane of old triangle
-			remain += d * to_new_other; //add it back in sticking out in plane of new triangle
+			remain += to_old_other * (d / old_len); //remove 'remain' sticking out in plane of old triangle
+			remain += to_new_other * (d / new_len); //add it back in sticking out in plane of new triangle
 		}
 	}
+
+	//rounding can leave the weights a hair off the triangle; keep them a valid barycentric point:
+	fix_weights(wp.weights);
+
+	return crossings;
 }
 
 
-WalkMeshes::WalkMeshes(std::string const &filename) {
-	std::ifstream file(filename, std::ios::binary);
+namespace {
+	//points per chunk when walking many points:
+	// (below this, handing work to other threads costs more than the walking)
+	constexpr uint32_t WalkPointsPerChunk = 1024;
+}
 
-	std::vector< glm::vec3 > vertices;
-	read_chunk(file, "p...", &vertices);
+void WalkMesh::walk(WalkPoints &points, std::vector< glm::vec3 > const &steps) const {
+	assert(steps.size() == points.size());
+	assert(points.triangles.size() == points.size() && points.weights.size() == points.size());
+
+	//each point only depends on its own step, so the way points are split over threads doesn't change the results:
+	parallel_chunks(uint32_t(points.size()), WalkPointsPerChunk, [&](uint32_t begin, uint32_t end) {
+		uint32_t i = begin;
+#ifdef WALKMESH_USE_SSE
+		//four points at a time: project all four steps to their triangles at once, and finish right here every step that
+		// stays inside its triangle (the common case for small steps). The others carry on in walk() from the coordinates
+		// computed here -- exactly the ones walk() would have computed, since step_coords() does the same operations for each lane.
+		__m128 const zero = _mm_setzero_ps();
+		__m128 const one = _mm_set1_ps(1.0f);
+		__m128 const sign = _mm_set1_ps(-0.0f);
+		for (; i + 4 <= end; i += 4) {
+			float fa[3][4], fb[3][4], fc[3][4], fr[3][4], fw[3][4];
+			for (uint32_t l = 0; l < 4; ++l) {
+				glm::uvec3 const &tri = points.triangles[i+l];
+				glm::vec3 const &a = vertices[tri.x];
+				glm::vec3 const &b = vertices[tri.y];
+				glm::vec3 const &c = vertices[tri.z];
+				glm::vec3 const &r = steps[i+l];
+				glm::vec3 const &w = points.weights[i+l];
+				for (uint32_t k = 0; k < 3; ++k) {
+					fa[k][l] = a[k]; fb[k][l] = b[k]; fc[k][l] = c[k]; fr[k][l] = r[k]; fw[k][l] = w[k];
+				}
+			}
+			Lanes a[3], b[3], c[3], r[3], coords[3];
+			for (uint32_t k = 0; k < 3; ++k) {
+				a[k] = _mm_loadu_ps(fa[k]);
+				b[k] = _mm_loadu_ps(fb[k]);
+				c[k] = _mm_loadu_ps(fc[k]);
+				r[k] = _mm_loadu_ps(fr[k]);
+			}
+			step_coords(a, b, c, r, coords);
+
+			//a step stays inside when no weight reaches zero before its end (walk()'s test: -weight / coord in [0,1) for a negative coord):
+			// (steps of zero go to walk() too, which leaves their weights alone)
+			float fcoords[3][4];
+			__m128 moving = _mm_setzero_ps();
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			__m128 w[3];
+			for (uint32_t k = 0; k < 3; ++k) {
+				__m128 wk = _mm_loadu_ps(fw[k]);
+				__m128 ck = coords[k].v;
+				_mm_storeu_ps(fcoords[k], ck);
+				moving = _mm_or_ps(moving, _mm_cmpneq_ps(r[k].v, zero));
+				inside = _mm_and_ps(inside, _mm_cmpord_ps(ck, ck)); //(NaNs go to walk(), which asserts on them)
+				__m128 q = _mm_div_ps(_mm_xor_ps(wk, sign), ck);
+				__m128 test = _mm_and_ps(_mm_cmplt_ps(zero, q), q); //std::max(0.0f, q)
+				__m128 hit = _mm_and_ps(_mm_cmplt_ps(ck, zero), _mm_cmplt_ps(test, one));
+				inside = _mm_andnot_ps(hit, inside);
+				w[k] = _mm_add_ps(wk, ck);
+			}
+			int done = _mm_movemask_ps(_mm_and_ps(inside, moving));
 
-	std::vector< glm::vec3 > normals;
-	read_chunk(file, "n...", &normals);
+			//fix_weights(), four at a time:
+			for (uint32_t k = 0; k < 3; ++k) {
+				w[k] = _mm_andnot_ps(_mm_cmplt_ps(w[k], zero), w[k]);
+			}
+			__m128 sum = _mm_add_ps(_mm_add_ps(w[0], w[1]), w[2]);
+			for (uint32_t k = 0; k < 3; ++k) {
+				_mm_storeu_ps(fw[k], _mm_div_ps(w[k], sum));
+			}
 
-	std::vector< glm::uvec3 > triangles;
-	read_chunk(file, "tri0", &triangles);
+			for (uint32_t l = 0; l < 4; ++l) {
+				if (done & (1 << l)) {
+					points.weights[i+l] = glm::vec3(fw[0][l], fw[1][l], fw[2][l]);
+				} else {
+					WalkPoint wp = points.get(i+l);
+					glm::vec3 first = glm::vec3(fcoords[0][l], fcoords[1][l], fcoords[2][l]);
+					walk(wp, steps[i+l], &first);
+					points.set(i+l, wp);
+				}
+			}
+		}
+#endif
+		for (; i < end; ++i) {
+			WalkPoint wp = points.get(i);
+			walk(wp, steps[i]);
+			points.set(i, wp);
+		}
+	});
+}
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+void WalkMesh::world_points(WalkPoints const &points, std::vector< glm::vec3 > *out_) const {
+	assert(out_);
+	auto &out = *out_;
+	out.resize(points.size());
+	parallel_chunks(uint32_t(points.size()), WalkPointsPerChunk, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			glm::uvec3 const &tri = points.triangles[i];
+			glm::vec3 const &w = points.weights[i];
+			out[i] = w.x * vertices[tri.x] + w.y * vertices[tri.y] + w.z * vertices[tri.z];
+		}
+	});
+}
+
+WalkMeshes::WalkMeshes(std::string const &filename) {
+	file.reset(new ChunkFile(filename));
+
+	auto vertices = file->read< glm::vec3 >("p...");
+	auto normals = file->read< glm::vec3 >("n...");
+	auto triangles = file->read< glm::uvec3 >("tri0");
+	auto names = file->read< char >("str0");
 
 	struct IndexEntry {
 		uint32_t name_begin, name_end;
@@ -236,10 +667,18 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 		uint32_t triangle_begin, triangle_end;
 	};
 
-	std::vector< IndexEntry > index;
-	read_chunk(file, "idxA", &index);
+	auto index = file->read< IndexEntry >("idxA");
 
-	if (file.peek() != EOF) {
+	//adjacency, per triangle, indexed within each mesh (optional -- older files don't have it):
+	ChunkFile::Span< uint32_t > adjacency;
+	if (file->next_is("adj0")) {
+		adjacency = file->read< uint32_t >("adj0");
+		if (adjacency.size() != 3 * triangles.size()) {
+			throw std::runtime_error("Adjacency size doesn't match triangle count in '" + filename + "'");
+		}
+	}
+
+	if (!file->at_end()) {
 		std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
 	}
 
@@ -249,6 +688,11 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 		throw std::runtime_error("Mis-matched position and normal sizes in '" + filename + "'");
 	}
 
+	if (adjacency.empty() && !triangles.empty()) {
+		std::cerr << "NOTE: computing adjacency for '" << filename << "' (re-export it to store adjacency in the file)." << std::endl;
+		computed_adjacency.resize(3 * triangles.size());
+	}
+
 	for (auto const &e : index) {
 		if (!(e.name_begin <= e.name_end && e.name_end <= names.size())) {
 			throw std::runtime_error("Invalid name indices in index of '" + filename + "'");
@@ -260,28 +704,40 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 			throw std::runtime_error("Invalid triangle indices in index of '" + filename + "'");
 		}
 
-		//copy vertices/normals:
-		std::vector< glm::vec3 > wm_vertices(vertices.begin() + e.vertex_begin, vertices.begin() + e.vertex_end);
-		std::vector< glm::vec3 > wm_normals(normals.begin() + e.vertex_begin, normals.begin() + e.vertex_end);
-
-		//remap triangles:
-		std::vector< glm::uvec3 > wm_triangles; wm_triangles.reserve(e.triangle_end - e.triangle_begin);
-		for (uint32_t ti = e.triangle_begin; ti != e.triangle_end; ++ti) {
-			if (!( (e.vertex_begin <= triangles[ti].x && triangles[ti].x < e.vertex_end)
-			    && (e.vertex_begin <= triangles[ti].y && triangles[ti].y < e.vertex_end)
-			    && (e.vertex_begin <= triangles[ti].z && triangles[ti].z < e.vertex_end) )) {
+		//triangles refer to vertices by their index in the whole file, so meshes view all of 'vertices':
+		ChunkFile::Span< glm::uvec3 > wm_triangles(triangles.begin() + e.triangle_begin, triangles.begin() + e.triangle_end);
+		for (auto const &tri : wm_triangles) {
+			if (!( (e.vertex_begin <= tri.x && tri.x < e.vertex_end)
+			    && (e.vertex_begin <= tri.y && tri.y < e.vertex_end)
+			    && (e.vertex_begin <= tri.z && tri.z < e.vertex_end) )) {
 				throw std::runtime_error("Invalid triangle in '" + filename + "'");
 			}
-			wm_triangles.emplace_back(
-				triangles[ti].x - e.vertex_begin,
-				triangles[ti].y - e.vertex_begin,
-				triangles[ti].z - e.vertex_begin
-			);
 		}
-		
+
+		ChunkFile::Span< uint32_t > wm_adjacency;
+		if (!adjacency.empty()) {
+			wm_adjacency = ChunkFile::Span< uint32_t >(adjacency.begin() + 3 * e.triangle_begin, adjacency.begin() + 3 * e.triangle_end);
+			//walking trusts adjacency, so make sure every entry really names the same edge running the other way:
+			for (uint32_t i = 0; i < wm_adjacency.size(); ++i) {
+				uint32_t across = wm_adjacency[i];
+				if (across == -1U) continue;
+				glm::uvec3 const &tri = wm_triangles[i / 3];
+				uint32_t u = across >> 2, j = across & 3;
+				if (!( u < wm_triangles.size() && j < 3
+				    && wm_triangles[u][j] == tri[(i % 3 + 1) % 3]
+				    && wm_triangles[u][(j+1)%3] == tri[i % 3] )) {
+					throw std::runtime_error("Invalid adjacency in '" + filename + "'");
+				}
+			}
+		} else {
+			uint32_t *out = computed_adjacency.data() + 3 * e.triangle_begin;
+			WalkMesh::compute_adjacency(wm_triangles, out);
+			wm_adjacency = ChunkFile::Span< uint32_t >(out, out + 3 * wm_triangles.size());
+		}
+
 		std::string name(names.begin() + e.name_begin, names.begin() + e.name_end);
 
-		auto ret = meshes.emplace(name, WalkMesh(wm_vertices, wm_normals, wm_triangles));
+		auto ret = meshes.emplace(name, WalkMesh(vertices, normals, wm_triangles, wm_adjacency));
 		if (!ret.second) {
 			throw std::runtime_error("WalkMesh with duplicated name '" + name + "' in '" + filename + "'");
 		}
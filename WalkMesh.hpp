@@ -1,36 +1,98 @@
 #pragma once
 
+#include "ChunkFile.hpp"
+
+#include <glm/glm.hpp>
+
 #include <vector>
-#include <unordered_map>
 #include <map>
-
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp> //allows the use of 'uvec2' as an unordered_map key
+#include <memory>
+#include <string>
+#include <limits>
+#include <cstdint>
 
 struct WalkMesh {
 	//Walk mesh will keep track of triangles, vertices:
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec3 > normals; //normals for interpolated 'up' direction
-	std::vector< glm::uvec3 > triangles; //CCW-oriented
+	// (these are read-only views -- into a WalkMeshes file shared by all its meshes, or into 'owned')
+	ChunkFile::Span< glm::vec3 > vertices; //(triangles may use only some of these)
+	ChunkFile::Span< glm::vec3 > normals; //normals for interpolated 'up' direction
+	ChunkFile::Span< glm::uvec3 > triangles; //CCW-oriented
 
-	//This "next vertex" map includes [a,b]->c, [b,c]->a, and [c,a]->b for each triangle, and is useful for checking what's over an edge from a given point:
-	std::unordered_map< glm::uvec2, uint32_t > next_vertex;
+	//Edge adjacency, for checking what's over an edge from a given point:
+	// edge k of triangle t runs from triangles[t][k] to triangles[t][(k+1)%3];
+	// adjacency[3*t+k] is (u << 2) | j, where edge j of triangle u is the same edge running the other way,
+	// or -1U if nothing is on the other side (the edge is solid).
+	ChunkFile::Span< uint32_t > adjacency;
 
 
-	//Construct new WalkMesh and build next_vertex structure:
+	//Construct new WalkMesh (copying the data) and build adjacency structure:
 	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_);
 
+	//Construct new WalkMesh viewing data that will outlive it (adjacency as computed by compute_adjacency):
+	WalkMesh(ChunkFile::Span< glm::vec3 > const &vertices_, ChunkFile::Span< glm::vec3 > const &normals_, ChunkFile::Span< glm::uvec3 > const &triangles_, ChunkFile::Span< uint32_t > const &adjacency_);
+
+	//fill adjacency[0 .. 3*triangles.size()) for a list of triangles:
+	static void compute_adjacency(ChunkFile::Span< glm::uvec3 > const &triangles, uint32_t *adjacency);
+
 	struct WalkPoint {
 		glm::uvec3 triangle = glm::uvec3(-1U); //indices of current triangle
 		glm::vec3 weights = glm::vec3(std::numeric_limits< float >::quiet_NaN()); //barycentric coordinates for current point
+		uint32_t face = -1U; //index of current triangle in 'triangles' ('triangle' is that triangle's vertices, possibly rotated)
 	};
 
 	//used to initialize walking -- finds the closest point on the walk mesh:
-	// (should only need to call this at the start of a level)
+	// (uses 'bvh', so it is fine to call often -- e.g., for respawns or teleports)
 	WalkPoint start(glm::vec3 const &world_point) const;
 
+	//same result as start(), but checks every triangle (kept as a reference for start()):
+	WalkPoint start_brute_force(glm::vec3 const &world_point) const;
+
 	//used to update walk point:
-	void walk(WalkPoint &wp, glm::vec3 const &step) const;
+	// (slides along solid edges, and stops where the step runs into a corner between them)
+	// returns the number of edges the step ran into (crossed or slid along) -- handy for profiling; callers may ignore it
+	uint32_t walk(WalkPoint &wp, glm::vec3 const &step) const;
+
+	enum : uint32_t {
+		//edge crossings allowed per step:
+		// (every crossing either moves the point, enters a new triangle, or takes a direction out of the step, so walks
+		//  always finish well before this -- it is only a safety net for steps that are huge compared to the triangles)
+		MaxWalkCrossings = 1024,
+	};
+
+	//many walk points (crowds, NPCs, particles on surfaces), stored field-by-field:
+	struct WalkPoints {
+		std::vector< glm::uvec3 > triangles;
+		std::vector< glm::vec3 > weights;
+		std::vector< uint32_t > faces;
+
+		size_t size() const { return faces.size(); }
+		void push_back(WalkPoint const &wp) {
+			triangles.emplace_back(wp.triangle);
+			weights.emplace_back(wp.weights);
+			faces.emplace_back(wp.face);
+		}
+		WalkPoint get(size_t i) const {
+			WalkPoint wp;
+			wp.triangle = triangles[i];
+			wp.weights = weights[i];
+			wp.face = faces[i];
+			return wp;
+		}
+		void set(size_t i, WalkPoint const &wp) {
+			triangles[i] = wp.triangle;
+			weights[i] = wp.weights;
+			faces[i] = wp.face;
+		}
+	};
+
+	//walk every point by its step (steps.size() == points.size()), splitting the work over several threads when there are many points:
+	// with SSE, steps are projected to their triangles four points at a time, and steps that stay inside their triangle are finished
+	// right there; points whose steps reach an edge carry on from those coordinates one at a time.
+	// (results are exactly the same as calling walk() on each point in turn)
+	void walk(WalkPoints &points, std::vector< glm::vec3 > const &steps) const;
+
+	//read back world_point() for every point (into 'out', resized to points.size()):
+	void world_points(WalkPoints const &points, std::vector< glm::vec3 > *out) const;
 
 	//used to read back results of walking:
 	glm::vec3 world_point(WalkPoint const &wp) const {
@@ -47,17 +109,52 @@ struct WalkMesh {
 		);
 	}
 
+	//internals:
+
+	//data for meshes constructed from vectors:
+	struct Owned {
+		std::vector< glm::vec3 > vertices;
+		std::vector< glm::vec3 > normals;
+		std::vector< glm::uvec3 > triangles;
+		std::vector< uint32_t > adjacency;
+	};
+	std::shared_ptr< Owned const > owned;
+
+	//DEBUG check that vertex normals agree with triangle orientation:
+	void check_normals() const;
+
+	//walk(), with the barycentric coordinates of 'step' in wp's triangle already computed when 'step_coords' isn't null (for the batched walk()):
+	uint32_t walk(WalkPoint &wp, glm::vec3 const &step, glm::vec3 const *step_coords) const;
+
+	//closest point to world_point on triangles[ti] (sets 'wp' and 'dis2'):
+	void closest_on_triangle(uint32_t ti, glm::vec3 const &world_point, WalkPoint *wp, float *dis2) const;
+
+	//bounding volume hierarchy over triangles (built by the constructor) for start():
+	struct BVHNode {
+		glm::vec3 min, max; //bounds (padded a bit to cover rounding in closest_on_triangle)
+		uint32_t first; //leaf: first index into bvh_triangles; interior: index of first child (second child follows it)
+		uint32_t count; //leaf: number of triangles; interior: 0
+	};
+	std::vector< BVHNode > bvh; //bvh[0] is the root
+	std::vector< uint32_t > bvh_triangles; //triangle indices, in leaf order
+	void build_bvh();
+
 };
 
 struct WalkMeshes {
 	//load a list of named WalkMeshes from a file:
+	// (the meshes view the file's data directly; adjacency is computed here if the file doesn't have an 'adj0' chunk)
 	WalkMeshes(std::string const &filename);
+	WalkMeshes(WalkMeshes const &) = delete;
+	WalkMeshes &operator=(WalkMeshes const &) = delete;
 
 	//retrieve a WalkMesh by name:
 	WalkMesh const &lookup(std::string const &name) const;
 
 	//internals:
 	std::map< std::string, WalkMesh > meshes;
+	std::unique_ptr< ChunkFile > file; //holds the data the meshes view
+	std::vector< uint32_t > computed_adjacency; //(only used for files without 'adj0')
 };
 
 /*
@@ -0,0 +1,231 @@
+#include "WalkPathfinder.hpp"
+
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <cassert>
+
+WalkPathfinder::WalkPathfinder(WalkMesh const &walkmesh_) : walkmesh(walkmesh_) {
+	searches.resize(1);
+}
+
+bool WalkPathfinder::find_path(WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to, std::vector< glm::vec3 > *path) {
+	assert(!searches.empty());
+	return searches[0].find_path(walkmesh, from, to, path);
+}
+
+namespace {
+	//queries per chunk when answering many queries:
+	// (a query is a whole A* search, so it doesn't take many to be worth handing to another thread)
+	constexpr uint32_t QueriesPerChunk = 16;
+
+	//can 'to' be reached from 'from' in a straight line (as seen from above each triangle crossed)?
+	// follows the line from triangle to triangle through WalkMesh::adjacency; fails at a solid edge,
+	// or if the line ends in a triangle other than to.face (e.g., on a floor above or below it).
+	bool in_straight_line(WalkMesh const &walkmesh, WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to) {
+		glm::vec3 start = walkmesh.world_point(from);
+		glm::vec3 goal = walkmesh.world_point(to);
+		uint32_t face = from.face;
+		//(every step moves to a triangle further along the line, so this bounds the loop even with float trouble)
+		for (uint32_t steps = 0; steps < walkmesh.triangles.size(); ++steps) {
+			if (face == to.face) return true;
+			glm::uvec3 const &tri = walkmesh.triangles[face];
+			glm::vec3 const &a = walkmesh.vertices[tri.x];
+			glm::vec3 up = glm::cross(walkmesh.vertices[tri.y] - a, walkmesh.vertices[tri.z] - a);
+			auto area = [&up](glm::vec3 const &p, glm::vec3 const &q, glm::vec3 const &r) {
+				return glm::dot(up, glm::cross(q - p, r - p));
+			};
+			//the line leaves through the edge that 'goal' is beyond, whose start is right of the line and whose end is left of it:
+			uint32_t exit = -1U;
+			for (uint32_t k = 0; k < 3; ++k) {
+				glm::vec3 const &v0 = walkmesh.vertices[tri[k]];
+				glm::vec3 const &v1 = walkmesh.vertices[tri[(k+1)%3]];
+				if (area(v0, v1, goal) < 0.0f && area(start, goal, v0) <= 0.0f && area(start, goal, v1) >= 0.0f) {
+					exit = k;
+					break;
+				}
+			}
+			if (exit == -1U) return false; //'goal' is over this triangle, but on another one
+			uint32_t across = walkmesh.adjacency[3*face+exit];
+			if (across == -1U) return false; //solid edge in the way
+			face = across >> 2;
+		}
+		return false;
+	}
+}
+
+void WalkPathfinder::find_paths(std::vector< Query > &queries) {
+	uint32_t count = uint32_t(queries.size());
+	uint32_t chunks = job_chunks(count, QueriesPerChunk);
+	if (searches.size() < chunks) searches.resize(chunks);
+
+	//each chunk takes its own search buffers (chunks may run at the same time):
+	std::atomic< uint32_t > next_search(0);
+	parallel_chunks(count, QueriesPerChunk, [this, &queries, &next_search](uint32_t begin, uint32_t end) {
+		Search &search = searches[next_search.fetch_add(1)];
+		for (uint32_t i = begin; i < end; ++i) {
+			Query &query = queries[i];
+			auto before = std::chrono::high_resolution_clock::now();
+			query.found = search.find_path(walkmesh, query.from, query.to, &query.path);
+			query.ms = std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+		}
+	});
+}
+
+bool WalkPathfinder::Search::find_path(WalkMesh const &walkmesh, WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to, std::vector< glm::vec3 > *path) {
+	assert(path);
+	path->clear();
+	if (in_straight_line(walkmesh, from, to)) {
+		//(nothing in the way, so no search needed -- and A*'s corridor might not have contained the straight line)
+		path->emplace_back(walkmesh.world_point(from));
+		glm::vec3 goal = walkmesh.world_point(to);
+		if (goal != path->back()) path->emplace_back(goal);
+		return true;
+	}
+	if (!find_corridor(walkmesh, from, to)) return false;
+	pull_string(path);
+	return true;
+}
+
+bool WalkPathfinder::Search::find_corridor(WalkMesh const &walkmesh, WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to) {
+	assert(from.face < walkmesh.triangles.size() && to.face < walkmesh.triangles.size());
+
+	//make sure buffers fit the mesh, and start a new generation of per-triangle state:
+	if (stamp.size() != walkmesh.triangles.size()) {
+		stamp.assign(walkmesh.triangles.size(), 0);
+		cost.resize(walkmesh.triangles.size());
+		at.resize(walkmesh.triangles.size());
+		came_from.resize(walkmesh.triangles.size());
+		generation = 0;
+	}
+	generation += 1;
+	if (generation == 0) { //(wrapped around, so old stamps could look current)
+		std::fill(stamp.begin(), stamp.end(), 0);
+		generation = 1;
+	}
+
+	glm::vec3 goal = walkmesh.world_point(to);
+
+	open.clear();
+	auto reach = [&](uint32_t face, float face_cost, glm::vec3 const &face_at, uint32_t face_came_from) {
+		stamp[face] = generation;
+		cost[face] = face_cost;
+		at[face] = face_at;
+		came_from[face] = face_came_from;
+		open.emplace_back(Open{face_cost + glm::distance(face_at, goal), face_cost, face});
+		std::push_heap(open.begin(), open.end());
+	};
+
+	//A*, where a route's position in each triangle is the midpoint of the edge it entered through:
+	reach(from.face, 0.0f, walkmesh.world_point(from), -1U);
+	bool reached = false;
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end());
+		Open current = open.back();
+		open.pop_back();
+		if (current.cost > cost[current.face]) continue; //(a better route to this triangle was found after this was queued)
+		if (current.face == to.face) {
+			reached = true;
+			break;
+		}
+
+		glm::uvec3 const &tri = walkmesh.triangles[current.face];
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t across = walkmesh.adjacency[3*current.face+k];
+			if (across == -1U) continue; //solid edge
+			uint32_t next = across >> 2;
+			glm::vec3 mid = 0.5f * (walkmesh.vertices[tri[k]] + walkmesh.vertices[tri[(k+1)%3]]);
+			float next_cost = current.cost + glm::distance(at[current.face], mid);
+			if (stamp[next] == generation && cost[next] <= next_cost) continue;
+			reach(next, next_cost, mid, (current.face << 2) | k);
+		}
+	}
+	if (!reached) return false;
+
+	//read back the corridor (end to start, then flip it around), framed by zero-width portals at 'from' and 'to':
+	auto normal = [&walkmesh](uint32_t face) {
+		glm::uvec3 const &tri = walkmesh.triangles[face];
+		glm::vec3 const &a = walkmesh.vertices[tri.x];
+		return glm::cross(walkmesh.vertices[tri.y] - a, walkmesh.vertices[tri.z] - a);
+	};
+	portals.clear();
+	portals.emplace_back(Portal{goal, goal, normal(to.face)});
+	for (uint32_t face = to.face; came_from[face] != -1U; face = came_from[face] >> 2) {
+		uint32_t prev = came_from[face] >> 2;
+		uint32_t k = came_from[face] & 3;
+		glm::uvec3 const &tri = walkmesh.triangles[prev];
+		//(leaving a CCW triangle through edge k, its end vertex is on the left and its start vertex on the right)
+		portals.emplace_back(Portal{walkmesh.vertices[tri[(k+1)%3]], walkmesh.vertices[tri[k]], normal(prev)});
+	}
+	glm::vec3 start = walkmesh.world_point(from);
+	portals.emplace_back(Portal{start, start, normal(from.face)});
+	std::reverse(portals.begin(), portals.end());
+
+	return true;
+}
+
+void WalkPathfinder::Search::pull_string(std::vector< glm::vec3 > *path) const {
+	//funnel algorithm (as in Mikko Mononen's "Simple Stupid Funnel Algorithm"):
+	// the funnel runs from 'apex' through 'left' and 'right'; each portal narrows it, and when one side
+	// would cross the other, that side's point becomes a corner of the path and the new apex.
+	// a side still at the apex (just after a restart, or while portals fan out around the apex) bounds nothing,
+	// so the other side can't cross it -- otherwise the apex itself would be added as a corner again.
+	assert(portals.size() >= 2);
+	glm::vec3 apex = portals[0].left;
+	glm::vec3 left = portals[0].left;
+	glm::vec3 right = portals[0].right;
+	uint32_t apex_index = 0, left_index = 0, right_index = 0;
+
+	path->emplace_back(apex);
+	auto add_corner = [path](glm::vec3 const &corner) {
+		if (path->back() != corner) path->emplace_back(corner);
+	};
+
+	for (uint32_t i = 1; i < portals.size(); ++i) {
+		Portal const &portal = portals[i];
+
+		//twice the signed area of a-b-c, positive when 'c' is left of a->b (looking down 'up'):
+		glm::vec3 const &up = portal.up;
+		auto area = [&up](glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) {
+			return glm::dot(up, glm::cross(b - a, c - a));
+		};
+
+		//narrow the right side?
+		if (area(apex, right, portal.right) >= 0.0f) {
+			if (apex == right || apex == left || area(apex, left, portal.right) < 0.0f) {
+				right = portal.right;
+				right_index = i;
+			} else {
+				//right crossed over left, so left is a corner:
+				add_corner(left);
+				apex = left;
+				apex_index = left_index;
+				right = apex;
+				right_index = apex_index;
+				i = apex_index; //(restart scan from just past the new apex)
+				continue;
+			}
+		}
+
+		//narrow the left side?
+		if (area(apex, left, portal.left) <= 0.0f) {
+			if (apex == left || apex == right || area(apex, right, portal.left) > 0.0f) {
+				left = portal.left;
+				left_index = i;
+			} else {
+				//left crossed over right, so right is a corner:
+				add_corner(right);
+				apex = right;
+				apex_index = right_index;
+				left = apex;
+				left_index = apex_index;
+				i = apex_index;
+				continue;
+			}
+		}
+	}
+
+	add_corner(portals.back().left);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+//WalkPathfinder plans routes across a WalkMesh:
+// if nothing blocks the straight line between the two points, the route is just that line; otherwise
+// A* over its triangles (neighbors are found through WalkMesh::adjacency), then the funnel
+// ("string pulling") algorithm to turn the corridor of triangles into a short list of corner points.
+// (A* scores routes through edge midpoints, so a route around obstacles may be a little longer than the shortest one)
+//   WalkPathfinder pathfinder(walkmesh);
+//   std::vector< glm::vec3 > path;
+//   if (pathfinder.find_path(walkmesh.start(here), walkmesh.start(there), &path)) { ...head for path[1]... }
+// search buffers are kept between queries, so (once they have grown to fit the mesh) queries don't allocate.
+struct WalkPathfinder {
+	WalkPathfinder(WalkMesh const &walkmesh);
+
+	WalkMesh const &walkmesh; //must outlive the pathfinder
+
+	//find a path from 'from' to 'to' (both on 'walkmesh'):
+	// on success, 'path' holds the world-space points to travel through, starting at 'from' and ending at 'to'
+	// (no two points in a row are the same, so there is only one point if 'from' and 'to' are)
+	// returns false (with 'path' empty) if 'to' can't be reached from 'from'
+	// (uses this pathfinder's search buffers, so don't call from several threads at once -- use find_paths)
+	bool find_path(WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to, std::vector< glm::vec3 > *path);
+
+	struct Query {
+		WalkMesh::WalkPoint from, to;
+		std::vector< glm::vec3 > path; //result, as for find_path (storage is reused if the query is)
+		bool found = false;
+		float ms = 0.0f; //time spent on this query, for latency reports
+	};
+
+	//answer many queries, spread over the worker threads (see jobs.hpp) in chunks that each use their own search buffers:
+	// (e.g., for all the agents that need a new route this frame)
+	void find_paths(std::vector< Query > &queries);
+
+	//internals:
+
+	//buffers for one search at a time:
+	struct Search {
+		//per-triangle state, valid only where stamp[face] == generation (so nothing needs clearing between queries):
+		std::vector< uint32_t > stamp;
+		std::vector< float > cost; //length of best known route to the triangle
+		std::vector< glm::vec3 > at; //point the route enters the triangle (edge midpoint, or 'from')
+		std::vector< uint32_t > came_from; //(previous triangle << 2) | edge of it crossed, or -1U at 'from'
+		uint32_t generation = 0;
+
+		struct Open {
+			float estimate; //cost + distance left
+			float cost;
+			uint32_t face;
+			bool operator<(Open const &o) const { return estimate > o.estimate; } //(for a min-heap)
+		};
+		std::vector< Open > open;
+
+		//corridor found by A*, as portals (crossed edges, as seen from the side the route approaches):
+		struct Portal {
+			glm::vec3 left, right;
+			glm::vec3 up; //normal of the triangle before the portal, for telling left from right
+		};
+		std::vector< Portal > portals;
+
+		bool find_path(WalkMesh const &walkmesh, WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to, std::vector< glm::vec3 > *path);
+		bool find_corridor(WalkMesh const &walkmesh, WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to);
+		void pull_string(std::vector< glm::vec3 > *path) const;
+	};
+	std::vector< Search > searches; //searches[0] is used by find_path; find_paths uses one per chunk
+};
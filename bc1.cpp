@@ -0,0 +1,126 @@
+#include "bc1.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static uint16_t pack_565(glm::vec3 const &c) {
+	glm::ivec3 q = glm::clamp(glm::ivec3(glm::round(c * glm::vec3(31.0f, 63.0f, 31.0f) / 255.0f)), glm::ivec3(0), glm::ivec3(31, 63, 31));
+	return uint16_t((q.x << 11) | (q.y << 5) | q.z);
+}
+
+static glm::ivec3 unpack_565(uint16_t c) {
+	int r = (c >> 11) & 0x1f;
+	int g = (c >> 5) & 0x3f;
+	int b = c & 0x1f;
+	return glm::ivec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+//the four colors a block can use (the last is black when c0 <= c1, which is BC1's one-bit alpha mode):
+static void bc1_palette(uint16_t c0, uint16_t c1, glm::ivec3 palette[4]) {
+	palette[0] = unpack_565(c0);
+	palette[1] = unpack_565(c1);
+	if (c0 > c1) {
+		palette[2] = (2 * palette[0] + palette[1]) / 3;
+		palette[3] = (palette[0] + 2 * palette[1]) / 3;
+	} else {
+		palette[2] = (palette[0] + palette[1]) / 2;
+		palette[3] = glm::ivec3(0);
+	}
+}
+
+static void compress_block(glm::ivec3 const block[16], uint8_t *out) {
+	//find the direction the colors vary the most (power iteration on the covariance):
+	glm::vec3 mean(0.0f);
+	for (uint32_t i = 0; i < 16; ++i) mean += glm::vec3(block[i]);
+	mean /= 16.0f;
+	glm::mat3 cov(0.0f);
+	for (uint32_t i = 0; i < 16; ++i) {
+		glm::vec3 d = glm::vec3(block[i]) - mean;
+		cov += glm::outerProduct(d, d);
+	}
+	glm::vec3 axis(1.0f, 1.0f, 1.0f);
+	for (uint32_t iter = 0; iter < 8; ++iter) {
+		axis = cov * axis;
+		float len = glm::length(axis);
+		if (len < 1e-6f) break;
+		axis /= len;
+	}
+
+	//endpoints are the colors furthest along that direction:
+	uint32_t lo = 0, hi = 0;
+	float lo_t = 0.0f, hi_t = 0.0f;
+	for (uint32_t i = 0; i < 16; ++i) {
+		float t = glm::dot(glm::vec3(block[i]) - mean, axis);
+		if (i == 0 || t < lo_t) { lo = i; lo_t = t; }
+		if (i == 0 || t > hi_t) { hi = i; hi_t = t; }
+	}
+	uint16_t c0 = pack_565(glm::vec3(block[hi]));
+	uint16_t c1 = pack_565(glm::vec3(block[lo]));
+	if (c0 < c1) std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1) { //(when c0 == c1 every pixel uses index 0)
+		glm::ivec3 palette[4];
+		bc1_palette(c0, c1, palette);
+		for (uint32_t i = 0; i < 16; ++i) {
+			uint32_t best = 0;
+			int best_dis2 = 0;
+			for (uint32_t p = 0; p < 4; ++p) {
+				glm::ivec3 d = block[i] - palette[p];
+				int dis2 = d.x * d.x + d.y * d.y + d.z * d.z;
+				if (p == 0 || dis2 < best_dis2) {
+					best = p;
+					best_dis2 = dis2;
+				}
+			}
+			indices |= best << (2 * i);
+		}
+	}
+
+	//(little-endian, like the GPU expects)
+	out[0] = uint8_t(c0); out[1] = uint8_t(c0 >> 8);
+	out[2] = uint8_t(c1); out[3] = uint8_t(c1 >> 8);
+	out[4] = uint8_t(indices); out[5] = uint8_t(indices >> 8);
+	out[6] = uint8_t(indices >> 16); out[7] = uint8_t(indices >> 24);
+}
+
+void compress_bc1(uint32_t w, uint32_t h, glm::u8vec4 const *pixels, std::vector< uint8_t > *out) {
+	out->assign(bc1_size(w, h), 0);
+	uint8_t *block_out = out->data();
+	for (uint32_t by = 0; by < h; by += 4) {
+		for (uint32_t bx = 0; bx < w; bx += 4) {
+			glm::ivec3 block[16];
+			for (uint32_t y = 0; y < 4; ++y) {
+				for (uint32_t x = 0; x < 4; ++x) {
+					//(pixels past the edge repeat the edge)
+					glm::u8vec4 const &px = pixels[std::min(by + y, h - 1) * w + std::min(bx + x, w - 1)];
+					block[y * 4 + x] = glm::ivec3(px.x, px.y, px.z);
+				}
+			}
+			compress_block(block, block_out);
+			block_out += BC1BlockBytes;
+		}
+	}
+}
+
+void decompress_bc1(uint32_t w, uint32_t h, uint8_t const *blocks, std::vector< glm::u8vec4 > *out) {
+	out->assign(w * h, glm::u8vec4(0));
+	uint8_t const *block = blocks;
+	for (uint32_t by = 0; by < h; by += 4) {
+		for (uint32_t bx = 0; bx < w; bx += 4) {
+			uint16_t c0 = uint16_t(block[0] | (block[1] << 8));
+			uint16_t c1 = uint16_t(block[2] | (block[3] << 8));
+			uint32_t indices = uint32_t(block[4]) | (uint32_t(block[5]) << 8) | (uint32_t(block[6]) << 16) | (uint32_t(block[7]) << 24);
+			glm::ivec3 palette[4];
+			bc1_palette(c0, c1, palette);
+			for (uint32_t y = 0; y < 4 && by + y < h; ++y) {
+				for (uint32_t x = 0; x < 4 && bx + x < w; ++x) {
+					uint32_t i = (indices >> (2 * (y * 4 + x))) & 3;
+					bool transparent = (c0 <= c1 && i == 3);
+					(*out)[(by + y) * w + (bx + x)] = glm::u8vec4(glm::u8vec3(palette[i]), transparent ? 0x00 : 0xff);
+				}
+			}
+			block += BC1BlockBytes;
+		}
+	}
+}
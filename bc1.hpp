@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+//BC1 (a.k.a. DXT1 or S3TC) compresses each 4x4 block of an opaque RGB image into 8 bytes:
+// two RGB565 endpoint colors and a 2-bit index per pixel choosing a color on the line between them.
+enum : uint32_t { BC1BlockBytes = 8 };
+
+//bytes needed for a w x h image (partial blocks at the right and top edges are stored as full blocks):
+inline uint32_t bc1_size(uint32_t w, uint32_t h) {
+	return ((w + 3) / 4) * ((h + 3) / 4) * BC1BlockBytes;
+}
+
+//compress w x h pixels (row-major, alpha ignored) into 'out' (replacing its contents):
+void compress_bc1(uint32_t w, uint32_t h, glm::u8vec4 const *pixels, std::vector< uint8_t > *out);
+
+//decompress a BC1 image back to w x h pixels (for GPUs without BC1 support):
+void decompress_bc1(uint32_t w, uint32_t h, uint8_t const *blocks, std::vector< glm::u8vec4 > *out);
@@ -1,16 +1,154 @@
 #include "compile_program.hpp"
 
+#include "startup_timing.hpp"
+#include "data_path.hpp"
+
+#include <SDL.h>
+
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+
+bool shader_cache_enabled = true;
+
+namespace {
+	//program binaries are GL 4.1 (or ARB_get_program_binary), so functions are looked up at runtime:
+	struct ProgramBinary {
+		PFNGLGETPROGRAMBINARYPROC GetProgramBinary = nullptr;
+		PFNGLPROGRAMBINARYPROC ProgramBinary = nullptr;
+		PFNGLPROGRAMPARAMETERIPROC ProgramParameteri = nullptr;
+		bool supported = false;
+		std::string driver; //vendor + renderer + version (binaries are only good for the driver that made them)
+	};
+
+	ProgramBinary const &get_program_binary() {
+		static ProgramBinary const program_binary = [](){
+			ProgramBinary ret;
+			if (!SDL_GL_ExtensionSupported("GL_ARB_get_program_binary")) return ret;
+			ret.GetProgramBinary = reinterpret_cast< PFNGLGETPROGRAMBINARYPROC >(SDL_GL_GetProcAddress("glGetProgramBinary"));
+			ret.ProgramBinary = reinterpret_cast< PFNGLPROGRAMBINARYPROC >(SDL_GL_GetProcAddress("glProgramBinary"));
+			ret.ProgramParameteri = reinterpret_cast< PFNGLPROGRAMPARAMETERIPROC >(SDL_GL_GetProcAddress("glProgramParameteri"));
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			ret.supported = ret.GetProgramBinary && ret.ProgramBinary && ret.ProgramParameteri && formats > 0;
+			for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+				GLubyte const *str = glGetString(name);
+				ret.driver += (str ? reinterpret_cast< char const * >(str) : "") + std::string("\n");
+			}
+			return ret;
+		}();
+		return program_binary;
+	}
+
+	//cache file header:
+	struct CacheHeader {
+		char magic[4] = {'s','h','b','0'};
+		uint32_t format = 0; //binary format from glGetProgramBinary
+		uint64_t key = 0; //hash of sources + driver
+	};
+	static_assert(sizeof(CacheHeader) == 16, "CacheHeader is packed.");
+
+	uint64_t cache_key(std::string const &vertex_shader_source, std::string const &fragment_shader_source, std::string const &driver) {
+		//FNV-1a (64-bit), with a separator between the strings:
+		uint64_t h = 14695981039346656037ull;
+		for (std::string const *str : {&vertex_shader_source, &fragment_shader_source, &driver}) {
+			for (char c : *str) {
+				h = (h ^ uint8_t(c)) * 1099511628211ull;
+			}
+			h = (h ^ 0xffu) * 1099511628211ull;
+		}
+		return h;
+	}
+
+	std::string cache_filename(uint64_t key) {
+		char hex[17];
+		std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+		return user_path("shader-cache/" + std::string(hex) + ".bin");
+	}
 
-static GLuint compile_shader(GLenum type, std::string const &source) {
+	//try to make a program from a cached binary; returns 0 if that isn't possible:
+	GLuint load_cached_program(ProgramBinary const &pb, uint64_t key) {
+		std::ifstream file(cache_filename(key), std::ios::binary);
+		if (!file) return 0;
+		std::vector< char > data((std::istreambuf_iterator< char >(file)), std::istreambuf_iterator< char >());
+		CacheHeader header;
+		if (data.size() <= sizeof(header)) return 0;
+		std::memcpy(&header, data.data(), sizeof(header));
+		if (std::string(header.magic, 4) != "shb0" || header.key != key) return 0;
+
+		GLuint program = glCreateProgram();
+		pb.ProgramBinary(program, header.format, data.data() + sizeof(header), GLsizei(data.size() - sizeof(header)));
+		GLint link_status = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+		if (link_status != GL_TRUE) {
+			//driver rejected the binary (e.g., it was updated), so compile instead:
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	void save_cached_program(ProgramBinary const &pb, uint64_t key, GLuint program) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) return;
+		std::vector< char > data(sizeof(CacheHeader) + length);
+		CacheHeader header;
+		header.key = key;
+		GLsizei written = 0;
+		pb.GetProgramBinary(program, length, &written, &header.format, data.data() + sizeof(CacheHeader));
+		if (written <= 0) return;
+		data.resize(sizeof(CacheHeader) + written);
+		std::memcpy(data.data(), &header, sizeof(header));
+
+		//write to a temporary file first so a partly-written cache file is never read:
+		std::string filename = cache_filename(key);
+		std::string temp = filename + ".tmp";
+		{
+			std::ofstream file(temp, std::ios::binary);
+			file.write(data.data(), data.size());
+			if (!file) {
+				std::cerr << "WARNING: failed to write shader cache file '" << temp << "'." << std::endl;
+				return;
+			}
+		}
+		std::remove(filename.c_str());
+		if (std::rename(temp.c_str(), filename.c_str()) != 0) {
+			std::remove(temp.c_str());
+		}
+	}
+}
+
+//turn on the driver's compiler threads (GL_KHR_parallel_shader_compile or GL_ARB_parallel_shader_compile), if it has them:
+static void enable_parallel_compile() {
+	static bool enabled = false;
+	if (enabled) return;
+	enabled = true;
+	PFNGLMAXSHADERCOMPILERTHREADSARBPROC MaxShaderCompilerThreads = nullptr;
+	if (SDL_GL_ExtensionSupported("GL_KHR_parallel_shader_compile")) {
+		MaxShaderCompilerThreads = reinterpret_cast< PFNGLMAXSHADERCOMPILERTHREADSARBPROC >(SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsKHR"));
+	} else if (SDL_GL_ExtensionSupported("GL_ARB_parallel_shader_compile")) {
+		MaxShaderCompilerThreads = reinterpret_cast< PFNGLMAXSHADERCOMPILERTHREADSARBPROC >(SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsARB"));
+	}
+	//0xffffffff means "as many threads as the driver likes":
+	if (MaxShaderCompilerThreads) MaxShaderCompilerThreads(0xffffffff);
+}
+
+static GLuint start_compile_shader(GLenum type, std::string const &source) {
 	GLuint shader = glCreateShader(type);
 	GLchar const *str = source.c_str();
 	GLint length = GLint(source.size());
 	glShaderSource(shader, 1, &str, &length);
 	glCompileShader(shader);
+	return shader;
+}
+
+static void check_compile_shader(GLuint shader) {
 	GLint compile_status = GL_FALSE;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
 	if (compile_status != GL_TRUE) {
@@ -21,42 +159,97 @@ static GLuint compile_shader(GLenum type, std::string const &source) {
 		GLsizei length = 0;
 		glGetShaderInfoLog(shader, GLint(info_log.size()), &length, &info_log[0]);
 		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-		glDeleteShader(shader);
 		throw std::runtime_error("Failed to compile shader.");
 	}
-	return shader;
 }
 
-GLuint compile_program(
+PendingProgram start_compile_program(
 	std::string const &vertex_shader_source,
 	std::string const &fragment_shader_source
 	) {
+	PendingProgram pending;
+
+	ProgramBinary const &pb = get_program_binary();
+	pending.use_cache = shader_cache_enabled && pb.supported;
+	if (pending.use_cache) {
+		StartupTimer timer("compile_program (from cache)");
+		pending.cache_key = cache_key(vertex_shader_source, fragment_shader_source, pb.driver);
+		pending.program = load_cached_program(pb, pending.cache_key);
+		if (pending.program != 0) {
+			pending.linked = true;
+			return pending;
+		}
+		timer.name = "compile_program (cache miss)";
+	}
 
-	GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_shader_source);
-	GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
+	StartupTimer timer("compile_program (submit)");
 
-	GLuint program = glCreateProgram();
-	glAttachShader(program, vertex_shader);
-	glAttachShader(program, fragment_shader);
+	enable_parallel_compile();
+
+	//nothing here waits for the compiler; errors are checked in finish_compile_program():
+	pending.vertex_shader = start_compile_shader(GL_VERTEX_SHADER, vertex_shader_source);
+	pending.fragment_shader = start_compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
+
+	pending.program = glCreateProgram();
+	glAttachShader(pending.program, pending.vertex_shader);
+	glAttachShader(pending.program, pending.fragment_shader);
+
+	//ask to be able to read back the linked binary for the cache:
+	if (pending.use_cache) pb.ProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	glLinkProgram(pending.program);
+
+	return pending;
+}
+
+GLuint finish_compile_program(PendingProgram &pending) {
+	if (pending.linked) return pending.program;
+
+	StartupTimer timer("compile_program (wait)");
 
 	//shaders are reference counted so this makes sure they are freed after program is deleted:
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
+	// (but they are kept until here so that compile errors can be reported)
+	struct DeleteShaders {
+		PendingProgram &pending;
+		~DeleteShaders() {
+			glDeleteShader(pending.vertex_shader);
+			glDeleteShader(pending.fragment_shader);
+			pending.vertex_shader = pending.fragment_shader = 0;
+		}
+	} delete_shaders{pending};
 
-	//link the shader program and throw errors if linking fails:
-	glLinkProgram(program);
+	//throw errors if linking fails (checking compile status first for a more helpful log):
 	GLint link_status = GL_FALSE;
-	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+	glGetProgramiv(pending.program, GL_LINK_STATUS, &link_status);
 	if (link_status != GL_TRUE) {
+		try {
+			check_compile_shader(pending.vertex_shader);
+			check_compile_shader(pending.fragment_shader);
+		} catch (...) {
+			glDeleteProgram(pending.program);
+			pending.program = 0;
+			throw;
+		}
 		std::cerr << "Failed to link shader program." << std::endl;
 		GLint info_log_length = 0;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
+		glGetProgramiv(pending.program, GL_INFO_LOG_LENGTH, &info_log_length);
 		std::vector< GLchar > info_log(info_log_length, 0);
 		GLsizei length = 0;
-		glGetProgramInfoLog(program, GLint(info_log.size()), &length, &info_log[0]);
+		glGetProgramInfoLog(pending.program, GLint(info_log.size()), &length, &info_log[0]);
 		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
 		throw std::runtime_error("failed to link program");
 	}
 
-	return program;
+	if (pending.use_cache) save_cached_program(get_program_binary(), pending.cache_key, pending.program);
+
+	pending.linked = true;
+	return pending.program;
+}
+
+GLuint compile_program(
+	std::string const &vertex_shader_source,
+	std::string const &fragment_shader_source
+	) {
+	PendingProgram pending = start_compile_program(vertex_shader_source, fragment_shader_source);
+	return finish_compile_program(pending);
 }
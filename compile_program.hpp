@@ -3,9 +3,34 @@
 #include "GL.hpp"
 
 #include <string>
+#include <cstdint>
 
 //compiles+links an OpenGL shader program from source.
 // throws on compilation error.
 GLuint compile_program(
 	std::string const &vertex_shader_source,
 	std::string const &fragment_shader_source);
+
+//compile_program() in two steps: start_compile_program() hands the shaders to the driver without
+// waiting for the results, and finish_compile_program() checks them (throwing on error).
+//Starting several programs before finishing any lets the driver compile them at the same time
+// (it uses GL_KHR_parallel_shader_compile to ask for more compiler threads, where available).
+//Load<>s can do this with LoadFinishLater (see the *_program.cpp files).
+struct PendingProgram {
+	GLuint program = 0;
+	GLuint vertex_shader = 0;
+	GLuint fragment_shader = 0;
+	bool linked = false; //(true once checked, or if the program came from the shader cache)
+	bool use_cache = false;
+	uint64_t cache_key = 0;
+};
+
+PendingProgram start_compile_program(
+	std::string const &vertex_shader_source,
+	std::string const &fragment_shader_source);
+
+GLuint finish_compile_program(PendingProgram &pending);
+
+//compiled programs are cached in user_path("shader-cache/") when the driver supports program binaries;
+// set this to false to always compile from source (main.cpp's '--no-shader-cache' flag does this):
+extern bool shader_cache_enabled;
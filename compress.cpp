@@ -0,0 +1,118 @@
+#include "compress.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+//Compressed data is a series of sequences, each:
+//  token (1 byte): high four bits are literal count, low four are match length - MinMatch
+//  [literal count - 15, as 255-terminated bytes, if token's literal count is 15]
+//  literals
+//  --- the last sequence stops here; others continue: ---
+//  match offset (2 bytes, little endian, 1..65535 bytes back)
+//  [match length - MinMatch - 15, as 255-terminated bytes, if token's match length is 15]
+
+namespace {
+	constexpr size_t MinMatch = 4;
+	constexpr size_t MaxOffset = 65535;
+	constexpr uint32_t HashBits = 16;
+}
+
+void compress(char const *data, size_t size, std::vector< char > *out_) {
+	auto &out = *out_;
+	out.clear();
+	out.reserve(size + size / 255 + 16);
+
+	auto put_length = [&out](size_t length) {
+		while (length >= 255) {
+			out.emplace_back(char(255));
+			length -= 255;
+		}
+		out.emplace_back(char(length));
+	};
+
+	auto put_sequence = [&](size_t literal_begin, size_t literal_end, size_t offset, size_t match) {
+		size_t literals = literal_end - literal_begin;
+		size_t extra = (match ? match - MinMatch : 0);
+		out.emplace_back(char((std::min< size_t >(literals, 15) << 4) | std::min< size_t >(extra, 15)));
+		if (literals >= 15) put_length(literals - 15);
+		out.insert(out.end(), data + literal_begin, data + literal_end);
+		if (match) {
+			out.emplace_back(char(offset & 0xff));
+			out.emplace_back(char(offset >> 8));
+			if (extra >= 15) put_length(extra - 15);
+		}
+	};
+
+	//most recent position of each (hashed) four-byte sequence:
+	std::vector< size_t > recent(size_t(1) << HashBits, size_t(-1));
+
+	size_t anchor = 0; //start of pending literals
+	size_t at = 0;
+	while (at + MinMatch <= size) {
+		uint32_t seq;
+		std::memcpy(&seq, data + at, 4);
+		uint32_t hash = (seq * 2654435761u) >> (32 - HashBits);
+		size_t candidate = recent[hash];
+		recent[hash] = at;
+
+		if (candidate != size_t(-1) && at - candidate <= MaxOffset && std::memcmp(data + candidate, data + at, MinMatch) == 0) {
+			size_t match = MinMatch;
+			while (at + match < size && data[candidate + match] == data[at + match]) ++match;
+			put_sequence(anchor, at, at - candidate, match);
+			at += match;
+			anchor = at;
+		} else {
+			at += 1;
+		}
+	}
+	//final sequence is literals only (possibly none):
+	put_sequence(anchor, size, 0, 0);
+}
+
+bool decompress(char const *data, size_t size, char *out, size_t out_size) {
+	uint8_t const *in = reinterpret_cast< uint8_t const * >(data);
+	uint8_t const *in_end = in + size;
+	size_t written = 0;
+
+	//reads the rest of a length that doesn't fit in its token nibble:
+	auto get_length = [&](size_t length, size_t *result) {
+		if (length == 15) {
+			uint8_t b;
+			do {
+				if (in == in_end) return false;
+				b = *(in++);
+				length += b;
+			} while (b == 255);
+		}
+		*result = length;
+		return true;
+	};
+
+	while (in != in_end) {
+		uint8_t token = *(in++);
+
+		size_t literals;
+		if (!get_length(token >> 4, &literals)) return false;
+		if (literals > size_t(in_end - in) || literals > out_size - written) return false;
+		std::memcpy(out + written, in, literals);
+		in += literals;
+		written += literals;
+
+		if (in == in_end) break; //last sequence
+
+		if (in_end - in < 2) return false;
+		size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+		in += 2;
+		size_t match;
+		if (!get_length(token & 0xf, &match)) return false;
+		match += MinMatch;
+		if (offset == 0 || offset > written || match > out_size - written) return false;
+		//(byte-by-byte, since matches may overlap what they are writing)
+		for (size_t i = 0; i < match; ++i) {
+			out[written] = out[written - offset];
+			written += 1;
+		}
+	}
+	return written == out_size;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+//A small LZ77-style byte codec (in the spirit of LZ4) used for data archive entries.
+// favors fast decompression over compression ratio.
+
+//compress 'size' bytes at 'data' into 'out' (replacing its contents):
+void compress(char const *data, size_t size, std::vector< char > *out);
+
+//decompress 'size' bytes at 'data' into exactly 'out_size' bytes at 'out':
+// returns false (without reading or writing out of bounds) if the data is corrupt.
+bool decompress(char const *data, size_t size, char *out, size_t out_size);
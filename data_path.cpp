@@ -12,11 +12,16 @@
 #include <io.h>
 #elif defined(__APPLE__)
 #include <mach-o/dyld.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #elif defined(__linux__)
 #include <unistd.h>
 #include <sys/stat.h>
 #endif //WINDOWS
 
+#include <cstdlib>
+#include <stdexcept>
+
 //get_data_path() gets the directory containing the executable
 //  (...or the Resources directory on OSX if the code appears to be running in an app bundle)
 
@@ -71,3 +76,73 @@ std::string data_path(std::string const &suffix) {
 	static std::string path = get_data_path();
 	return path + "/" + suffix;
 }
+
+//name of the per-user directory (inside the OS's usual place for application data):
+static std::string const user_directory_name = "the-gates-4dx";
+
+//get_user_path() gets the directory for per-user files:
+static std::string get_user_path() {
+	#if defined(_WIN32)
+	std::string ret;
+	PWSTR folder = nullptr;
+	if (SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, NULL, &folder) == S_OK) {
+		int length = WideCharToMultiByte(CP_UTF8, 0, folder, -1, NULL, 0, NULL, NULL);
+		if (length > 0) {
+			std::vector< char > buffer(length);
+			WideCharToMultiByte(CP_UTF8, 0, folder, -1, &buffer[0], length, NULL, NULL);
+			ret = &buffer[0];
+		}
+	}
+	CoTaskMemFree(folder);
+	if (ret.empty()) ret = get_data_path(); //fall back to directory with executable
+	return ret + "\\" + user_directory_name;
+
+	#elif defined(__linux__)
+	//XDG base directory spec:
+	char const *xdg_data_home = std::getenv("XDG_DATA_HOME");
+	if (xdg_data_home && xdg_data_home[0] == '/') {
+		return std::string(xdg_data_home) + "/" + user_directory_name;
+	}
+	char const *home = std::getenv("HOME");
+	if (home && home[0] != '\0') {
+		return std::string(home) + "/.local/share/" + user_directory_name;
+	}
+	return get_data_path() + "/" + user_directory_name;
+
+	#elif defined(__APPLE__)
+	char const *home = std::getenv("HOME");
+	if (home && home[0] != '\0') {
+		return std::string(home) + "/Library/Application Support/" + user_directory_name;
+	}
+	return get_data_path() + "/" + user_directory_name;
+
+	#else
+	#error "No idea what the OS is."
+	#endif
+}
+
+bool make_directories(std::string const &path) {
+	for (size_t i = 1; i <= path.size(); ++i) {
+		if (i == path.size() || path[i] == '/' || path[i] == '\\') {
+			std::string prefix = path.substr(0, i);
+			#if defined(_WIN32)
+			_mkdir(prefix.c_str()); //(fails harmlessly if it exists)
+			#else
+			mkdir(prefix.c_str(), 0755);
+			#endif
+		}
+	}
+	#if defined(_WIN32)
+	return !path.empty() && _access(path.c_str(), 2 /* write */) == 0;
+	#else
+	return !path.empty() && access(path.c_str(), W_OK) == 0;
+	#endif
+}
+
+std::string user_path(std::string const &suffix) {
+	static std::string path = get_user_path();
+	std::string ret = path + "/" + suffix;
+	size_t slash = ret.find_last_of("/\\");
+	make_directories(ret.substr(0, slash));
+	return ret;
+}
@@ -9,6 +9,11 @@
 std::string data_path(std::string const &suffix);
 
 //user_path returns an OS-specific location for writing/reading user data.
-// use data_path for save games and config files.
+// use user_path for save games, config files, and caches.
+// (directories leading up to the returned path are created if needed)
 // std::ofstream config(user_path("game.save"));
 std::string user_path(std::string const &suffix);
+
+//make_directories creates a directory and any missing parents (like 'mkdir -p'):
+// returns false if, afterward, the directory still can't be written to.
+bool make_directories(std::string const &path);
@@ -1,16 +1,20 @@
 #include "depth_program.hpp"
 
 #include "compile_program.hpp"
+#include "gl_errors.hpp"
+#include "Scene.hpp"
 
-DepthProgram::DepthProgram() {
-	program = compile_program(
+#include <memory>
+
+PendingProgram DepthProgram::start_compile() {
+	return start_compile_program(
 		"#version 330\n"
-		"uniform mat4 object_to_clip;\n"
+		+ Scene::object_data_glsl() +
 		"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
 		"in vec3 Normal;\n" //DEBUG
 		"out vec3 color;\n" //DEBUG
 		"void main() {\n"
-		"	gl_Position = object_to_clip * Position;\n"
+		"	gl_Position = object_to_clip_data() * Position;\n"
 		"	color = 0.5 + 0.5 * Normal;\n" //DEBUG
 		"}\n"
 		,
@@ -22,10 +26,27 @@ DepthProgram::DepthProgram() {
 		"	fragColor = vec4(color, 1.0);\n"
 		"}\n"
 	);
+}
+
+DepthProgram::DepthProgram(PendingProgram &pending) {
+	program = finish_compile_program(pending);
+
+	object_base_int = glGetUniformLocation(program, "object_base");
+
+	glUseProgram(program);
+
+	GLuint object_data_samplerBuffer = glGetUniformLocation(program, "object_data");
+	glUniform1i(object_data_samplerBuffer, Scene::ObjectDataTextureUnit);
+
+	glUseProgram(0);
 
-	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
+	GL_ERRORS();
 }
 
-Load< DepthProgram > depth_program(LoadTagInit, [](){
-	return new DepthProgram();
+//(compiles at the same time as the other programs; see LoadFinishLater in Load.hpp)
+Load< DepthProgram > depth_program(LoadTagInit, LoadFinishLater, [](){
+	auto pending = std::make_shared< PendingProgram >(DepthProgram::start_compile());
+	return [pending](){
+		return new DepthProgram(*pending);
+	};
 });
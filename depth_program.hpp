@@ -1,14 +1,17 @@
 #include "GL.hpp"
 #include "Load.hpp"
+#include "compile_program.hpp"
 
 struct DepthProgram {
 	//opengl program object:
 	GLuint program = 0;
 
 	//uniform locations:
-	GLuint object_to_clip_mat4 = -1U;
+	GLuint object_base_int = -1U; //per-object matrices are read from Scene's object data (see Scene::object_data_glsl())
 
-	DepthProgram();
+	//compiled in two steps so all programs can compile at once (see start_compile_program()):
+	static PendingProgram start_compile();
+	DepthProgram(PendingProgram &pending); //finishes compiling, looks up uniform locations
 };
 
 extern Load< DepthProgram > depth_program;
@@ -9,8 +9,13 @@
 #include <glm/gtc/type_ptr.hpp>
 
 //------------ resources ------------
-Load< MeshBuffer > text_meshes(LoadTagInit, [](){
-	return new MeshBuffer(data_path("menu.p"));
+//(text is only needed by menus, so these load on first use; see prefetch_loads("text"))
+LazyLoad< MeshBuffer > text_meshes("text", LoadInBackground, [](){
+	MeshBuffer *ret = new MeshBuffer(data_path("menu.p"), MeshBuffer::DeferUpload);
+	return [ret](){
+		ret->upload();
+		return ret;
+	};
 });
 
 //font metrics for "text_meshes":
@@ -31,7 +36,7 @@ inline float char_spacing(char a, char b) {
 GLint text_program_mvp_mat4 = -1;
 GLint text_program_color_vec4 = -1;
 
-Load< GLuint > text_program(LoadTagInit, [](){
+LazyLoad< GLuint > text_program([](){
 	GLuint *ret = new GLuint(compile_program(
 		"#version 330\n"
 		"uniform mat4 mvp;\n"
@@ -55,7 +60,7 @@ Load< GLuint > text_program(LoadTagInit, [](){
 });
 
 //Binding for using text_program on text_meshes:
-Load< GLuint > text_meshes_for_text_program(LoadTagDefault, [](){
+LazyLoad< GLuint > text_meshes_for_text_program([](){
 	return new GLuint(text_meshes->make_vao_for_program(*text_program));
 });
 
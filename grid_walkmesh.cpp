@@ -0,0 +1,59 @@
+#include "grid_walkmesh.hpp"
+
+#include <random>
+#include <cmath>
+#include <cassert>
+
+void make_grid_walkmesh(uint32_t size, float holes, float bumps, uint32_t seed,
+	std::vector< glm::vec3 > *vertices_, std::vector< glm::vec3 > *normals_, std::vector< glm::uvec3 > *triangles_) {
+	assert(vertices_);
+	assert(normals_);
+	assert(triangles_);
+	auto &vertices = *vertices_;
+	auto &normals = *normals_;
+	auto &triangles = *triangles_;
+
+	std::mt19937 mt(seed);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+
+	//vertices on a (size+1)x(size+1) lattice, with heights from a few random waves:
+	glm::vec3 waves[3];
+	for (auto &w : waves) w = glm::vec3(unit(mt) * 0.5f + 0.1f, unit(mt) * 0.5f + 0.1f, unit(mt) * 6.2831853f);
+	vertices.clear();
+	vertices.reserve((size + 1) * (size + 1));
+	for (uint32_t y = 0; y <= size; ++y) {
+		for (uint32_t x = 0; x <= size; ++x) {
+			float h = 0.0f;
+			for (auto const &w : waves) h += std::sin(w.x * x + w.y * y + w.z);
+			vertices.emplace_back(float(x), float(y), bumps * h / 3.0f);
+		}
+	}
+
+	//two CCW triangles per cell that isn't a hole:
+	triangles.clear();
+	triangles.reserve(2 * size * size);
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			if (unit(mt) < holes) continue;
+			uint32_t a = y * (size + 1) + x;
+			uint32_t b = a + 1;
+			uint32_t c = a + (size + 1);
+			uint32_t d = c + 1;
+			triangles.emplace_back(a, b, d);
+			triangles.emplace_back(a, d, c);
+		}
+	}
+
+	//normals are (area-weighted) averages of the normals of the triangles around each vertex:
+	normals.assign(vertices.size(), glm::vec3(0.0f));
+	for (auto const &tri : triangles) {
+		glm::vec3 out = glm::cross(vertices[tri.y] - vertices[tri.x], vertices[tri.z] - vertices[tri.x]);
+		normals[tri.x] += out;
+		normals[tri.y] += out;
+		normals[tri.z] += out;
+	}
+	for (auto &n : normals) {
+		if (n == glm::vec3(0.0f)) n = glm::vec3(0.0f, 0.0f, 1.0f); //(vertex only used by holes)
+		else n = glm::normalize(n);
+	}
+}
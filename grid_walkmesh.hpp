@@ -0,0 +1,12 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+//generate a walkmesh (as written by walkgen): a square grid of 'size'x'size' unit cells, two CCW triangles each,
+// with smooth hills about 'bumps' high and a 'holes' fraction of cells removed at random (the same 'seed' gives the same mesh).
+// vertices are on the (size+1)x(size+1) lattice, so vertices only used by holes are left in.
+void make_grid_walkmesh(uint32_t size, float holes, float bumps, uint32_t seed,
+	std::vector< glm::vec3 > *vertices, std::vector< glm::vec3 > *normals, std::vector< glm::uvec3 > *triangles);
@@ -0,0 +1,127 @@
+#include "jobs.hpp"
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <algorithm>
+
+namespace {
+	struct Workers {
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque< std::function< void() > > jobs;
+		bool quit = false;
+		std::vector< std::thread > threads;
+
+		Workers(uint32_t count) {
+			for (uint32_t i = 0; i < count; ++i) {
+				threads.emplace_back([this](){
+					while (true) {
+						std::function< void() > job;
+						{
+							std::unique_lock< std::mutex > lock(mutex);
+							cv.wait(lock, [this](){ return quit || !jobs.empty(); });
+							if (jobs.empty()) return;
+							job = std::move(jobs.front());
+							jobs.pop_front();
+						}
+						job();
+					}
+				});
+			}
+		}
+		~Workers() {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				quit = true;
+			}
+			cv.notify_all();
+			for (auto &thread : threads) {
+				thread.join();
+			}
+		}
+		void run(std::function< void() > const &job) {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				jobs.emplace_back(job);
+			}
+			cv.notify_one();
+		}
+	};
+
+	uint32_t core_count() {
+		static uint32_t count = std::max(1u, std::thread::hardware_concurrency());
+		return count;
+	}
+
+	Workers &get_workers() {
+		static Workers workers(core_count());
+		return workers;
+	}
+}
+
+void run_job(std::function< void() > const &job) {
+	get_workers().run(job);
+}
+
+uint32_t job_chunks(uint32_t count, uint32_t min_per_chunk) {
+	return std::max(1u, std::min(core_count(), count / std::max(1u, min_per_chunk)));
+}
+
+void parallel_chunks(uint32_t count, uint32_t min_per_chunk, std::function< void(uint32_t, uint32_t) > const &fn) {
+	uint32_t chunks = job_chunks(count, min_per_chunk);
+	if (chunks == 1) {
+		fn(0, count);
+		return;
+	}
+
+	//chunks are claimed from a counter by the calling thread and by helper jobs;
+	// the caller only ever waits for chunks that are already running, never for a job still in the queue.
+	// (helpers that start after every chunk is claimed just return, so they never touch 'fn' after this returns)
+	struct Shared {
+		std::function< void(uint32_t, uint32_t) > const *fn = nullptr;
+		uint32_t count = 0;
+		uint32_t chunks = 0;
+		std::atomic< uint32_t > next{0};
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		uint32_t finished = 0;
+		std::exception_ptr error;
+
+		void work() {
+			while (true) {
+				uint32_t chunk = next.fetch_add(1);
+				if (chunk >= chunks) return;
+				std::exception_ptr chunk_error;
+				try {
+					(*fn)(uint32_t(uint64_t(count) * chunk / chunks), uint32_t(uint64_t(count) * (chunk+1) / chunks));
+				} catch (...) {
+					chunk_error = std::current_exception();
+				}
+				std::unique_lock< std::mutex > lock(mutex);
+				if (chunk_error && !error) error = chunk_error;
+				finished += 1;
+				if (finished == chunks) cv.notify_all();
+			}
+		}
+	};
+	auto shared = std::make_shared< Shared >();
+	shared->fn = &fn;
+	shared->count = count;
+	shared->chunks = chunks;
+
+	for (uint32_t i = 1; i < chunks; ++i) {
+		run_job([shared](){ shared->work(); });
+	}
+	shared->work();
+
+	std::unique_lock< std::mutex > lock(shared->mutex);
+	shared->cv.wait(lock, [&shared](){ return shared->finished == shared->chunks; });
+	if (shared->error) std::rethrow_exception(shared->error);
+}
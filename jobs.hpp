@@ -0,0 +1,22 @@
+#pragma once
+
+#include <functional>
+#include <cstdint>
+
+//jobs runs work on a shared pool of worker threads (one per core, started on first use and kept until exit):
+// use it instead of starting threads for short-lived work (e.g., every frame).
+//
+//  parallel_chunks(uint32_t(points.size()), 1024, [&](uint32_t begin, uint32_t end) {
+//    for (uint32_t i = begin; i < end; ++i) { ...points[i]... }
+//  });
+
+//run 'job' on a worker thread at some point (jobs start in the order they were added):
+void run_job(std::function< void() > const &job);
+
+//number of chunks parallel_chunks() splits 'count' items into (at least 'min_per_chunk' items each, at most one per core):
+uint32_t job_chunks(uint32_t count, uint32_t min_per_chunk);
+
+//call fn(begin, end) on job_chunks(count, min_per_chunk) contiguous ranges covering [0,count), using the workers and the calling thread:
+// returns once every range is done (rethrowing the first exception thrown, if any).
+// the calling thread works on ranges itself rather than waiting for workers, so this may be used from inside jobs.
+void parallel_chunks(uint32_t count, uint32_t min_per_chunk, std::function< void(uint32_t, uint32_t) > const &fn);
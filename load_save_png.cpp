@@ -1,49 +1,78 @@
 #include "load_save_png.hpp"
 
+#include "startup_timing.hpp"
+#include "Archive.hpp"
+#include "MappedFile.hpp"
+
 #include <png.h>
 
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstring>
 #include <vector>
 
 #define LOG_ERROR( X ) std::cerr << X << std::endl
 
 using std::vector;
 
-bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin);
-void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin);
-
+static bool load_png(png_rw_ptr read_fn, void *io, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin);
 
-void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin);
-void save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin);
 
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
 	assert(size);
-
-	std::ifstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
-		throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
+	StartupTimer timer("load_png " + filename.substr(filename.find_last_of("/\\") + 1));
+
+	//read from the data archive, if the file is there:
+	char const *archived = nullptr;
+	size_t archived_size = 0;
+	std::vector< char > storage;
+	if (find_in_data_archive(filename, &archived, &archived_size, &storage)) {
+		if (!load_png(archived, archived_size, size, data, origin)) {
+			throw std::runtime_error("Failed to read PNG image '" + filename + "' from data archive.");
+		}
+		return;
 	}
-	if (!load_png(file, &size->x, &size->y, data, origin)) {
+
+	//otherwise, map the file (MappedFile throws if it can't be opened):
+	MappedFile file(filename);
+	if (!load_png(file.data, file.size, size, data, origin)) {
 		throw std::runtime_error("Failed to read PNG image from '" + filename + "'.");
 	}
 }
 
-void save_png(std::string filename, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin) {
-	std::ofstream file(filename.c_str(), std::ios::binary);
-	save_png(file, width, height, data, origin);
+namespace {
+	struct MemoryReader {
+		char const *at;
+		char const *end;
+	};
 }
 
-
-static void user_read_data(png_structp png_ptr, png_bytep data, png_size_t length) {
-	std::istream *from = reinterpret_cast< std::istream * >(png_get_io_ptr(png_ptr));
+static void memory_read_data(png_structp png_ptr, png_bytep data, png_size_t length) {
+	MemoryReader *from = reinterpret_cast< MemoryReader * >(png_get_io_ptr(png_ptr));
 	assert(from);
-	if (!from->read(reinterpret_cast< char * >(data), length)) {
-		png_error(png_ptr, "Error reading.");
+	if (size_t(from->end - from->at) < length) {
+		png_error(png_ptr, "Error reading (past end of data).");
+	}
+	std::memcpy(data, from->at, length);
+	from->at += length;
+}
+
+bool load_png(char const *png_data, size_t png_size, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
+	assert(size);
+	MemoryReader reader{png_data, png_data + png_size};
+	return load_png(memory_read_data, &reader, &size->x, &size->y, data, origin);
+}
+
+void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin) {
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open PNG image file '" + filename + "' for writing.");
 	}
+	save_png(file, size.x, size.y, data, origin);
 }
 
+
 static void user_write_data(png_structp png_ptr, png_bytep data, png_size_t length) {
 	std::ostream *to = reinterpret_cast< std::ostream * >(png_get_io_ptr(png_ptr));
 	assert(to);
@@ -61,7 +90,7 @@ static void user_flush_data(png_structp png_ptr) {
 }
 
 
-bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin) {
+static bool load_png(png_rw_ptr read_fn, void *io, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin) {
 	assert(data);
 	uint32_t local_width, local_height;
 	if (width == nullptr) width = &local_width;
@@ -72,23 +101,24 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 	//Load a png file, as per the libpng docs:
 	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, (png_error_ptr)NULL, (png_error_ptr)NULL);
 
-	png_set_read_fn(png, &from, user_read_data);
-
 	if (!png) {
 		LOG_ERROR("  cannot alloc read struct.");
 		return false;
 	}
+
+	png_set_read_fn(png, io, read_fn);
 	png_infop info = png_create_info_struct(png);
 	if (!info) {
 		LOG_ERROR("  cannot alloc info struct.");
 		png_destroy_read_struct(&png, (png_infopp)NULL, (png_infopp)NULL);
 		return false;
 	}
-	png_bytep *row_pointers = NULL;
+	//row pointers are kept between calls (per thread, since textures decode on several threads at once):
+	// (this also keeps anything with a destructor out of the frame that longjmp() might skip)
+	static thread_local std::vector< png_bytep > row_pointers;
 	if (setjmp(png_jmpbuf(png))) {
 		LOG_ERROR("  png interal error.");
 		png_destroy_read_struct(&png, &info, (png_infopp)NULL);
-		if (row_pointers != NULL) delete[] row_pointers;
 		data->clear();
 		return false;
 	}
@@ -96,15 +126,18 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 	png_read_info(png, info);
 	unsigned int w = png_get_image_width(png, info);
 	unsigned int h = png_get_image_height(png, info);
-	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE)
+	//only ask for the transforms this image needs (8-bit RGBA -- the usual case -- needs none):
+	png_byte color_type = png_get_color_type(png, info);
+	png_byte bit_depth = png_get_bit_depth(png, info);
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
 		png_set_palette_to_rgb(png);
-	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY || png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA)
+	if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
 		png_set_gray_to_rgb(png);
-	if (!(png_get_color_type(png, info) & PNG_COLOR_MASK_ALPHA))
+	if (!(color_type & PNG_COLOR_MASK_ALPHA))
 		png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
-	if (png_get_bit_depth(png, info) < 8)
+	if (bit_depth < 8)
 		png_set_packing(png);
-	if (png_get_bit_depth(png,info) == 16)
+	if (bit_depth == 16)
 		png_set_strip_16(png);
 	//Ok, should be 32-bit RGBA now.
 
@@ -114,7 +147,7 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 	assert(rowbytes == w*sizeof(uint32_t));
 
 	data->resize(w*h);
-	row_pointers = new png_bytep[h];
+	row_pointers.resize(h);
 	for (unsigned int r = 0; r < h; ++r) {
 		if (origin == LowerLeftOrigin) {
 			row_pointers[h-1-r] = (png_bytep)(&(*data)[r*w]);
@@ -122,9 +155,8 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 			row_pointers[r] = (png_bytep)(&(*data)[r*w]);
 		}
 	}
-	png_read_image(png, row_pointers);
+	png_read_image(png, row_pointers.data());
 	png_destroy_read_struct(&png, &info, NULL);
-	delete[] row_pointers;
 
 	*width = w;
 	*height = h;
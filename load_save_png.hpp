@@ -3,8 +3,10 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <iosfwd>
 #include <vector>
 #include <stdint.h>
+#include <stddef.h>
 
 /*
  * Load and save PNG files.
@@ -16,5 +18,12 @@ enum OriginLocation {
 };
 
 //NOTE: load_png will throw on error
+// (files are memory-mapped, or read from the data archive; several threads may load at once)
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin);
+
+//decode a PNG that is already in memory; returns false on error:
+bool load_png(char const *png_data, size_t png_size, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin);
+//(save_png throws if the file can't be opened, but only logs encoding errors)
 void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin);
+//encode to a stream (e.g., a std::ostringstream, to keep the PNG in memory):
+void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin);
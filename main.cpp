@@ -10,6 +10,18 @@
 //The 'Sound' header has functions for managing sound:
 #include "Sound.hpp"
 
+//startup_timing is used for the '--startup-report' flag:
+#include "startup_timing.hpp"
+
+//compile_program is included for the '--no-shader-cache' flag:
+#include "compile_program.hpp"
+
+//FrameCapture saves screenshots (F12) and '--capture' image sequences:
+#include "FrameCapture.hpp"
+
+//data_path is used to find a place to put screenshots:
+#include "data_path.hpp"
+
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
@@ -28,6 +40,8 @@
 #include <fstream>
 #include <memory>
 #include <algorithm>
+#include <cstdio>
+#include <ctime>
 
 int main(int argc, char **argv) {
 #ifdef _WIN32
@@ -37,8 +51,37 @@ int main(int argc, char **argv) {
 		//TODO: this is where you set the title and size of your game window
 		std::string title = "THE GATES 4DX ULTIMATE";
 		glm::uvec2 size = glm::uvec2(640, 400);
+		//print where startup time went and quit after the first frame:
+		bool startup_report = false;
+		//save every frame into this directory (if not empty):
+		std::string capture_directory = "";
+		//quit after this many frames (if not zero):
+		uint32_t capture_frames = 0;
 	} config;
 
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--startup-report") {
+			config.startup_report = true;
+		} else if (arg == "--no-shader-cache") {
+			shader_cache_enabled = false;
+		} else if (arg == "--capture" && argi + 1 < argc) {
+			config.capture_directory = argv[argi+1];
+			argi += 1;
+			//(check now, rather than failing to save every frame later)
+			if (!make_directories(config.capture_directory)) {
+				std::cerr << "Can't create or write to capture directory '" << config.capture_directory << "'." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--capture-frames" && argi + 1 < argc) {
+			config.capture_frames = uint32_t(std::stoul(argv[argi+1]));
+			argi += 1;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--startup-report] [--no-shader-cache] [--capture <directory>] [--capture-frames <count>]" << std::endl;
+			return 1;
+		}
+	}
+
 	/*
 	//----- start connection to server ----
 	if (argc != 3) {
@@ -52,7 +95,9 @@ int main(int argc, char **argv) {
 	//------------  initialization ------------
 
 	//Initialize SDL library:
+	StartupTimer sdl_init_timer("SDL_Init");
 	SDL_Init(SDL_INIT_VIDEO);
+	sdl_init_timer.stop();
 
 	//Ask for an OpenGL context version 3.3, core profile, enable debug:
 	SDL_GL_ResetAttributes();
@@ -69,6 +114,7 @@ int main(int argc, char **argv) {
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
 	//create window:
+	StartupTimer window_timer("create window");
 	SDL_Window *window = SDL_CreateWindow(
 		config.title.c_str(),
 		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -83,8 +129,10 @@ int main(int argc, char **argv) {
 		std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
 		return 1;
 	}
+	window_timer.stop();
 
 	//Create OpenGL context:
+	StartupTimer context_timer("create OpenGL context");
 	SDL_GLContext context = SDL_GL_CreateContext(window);
 
 	if (!context) {
@@ -97,6 +145,7 @@ int main(int argc, char **argv) {
 	//On windows, load OpenGL extensions:
 	init_gl_shims();
 	#endif
+	context_timer.stop();
 
 	//Set VSYNC + Late Swap (prevents crazy FPS):
 	if (SDL_GL_SetSwapInterval(-1) != 0) {
@@ -110,16 +159,26 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound output --------------
+	StartupTimer sound_timer("Sound::init");
 	Sound::init();
+	sound_timer.stop();
 
 	//------------ load assets --------------
 
+	StartupTimer load_timer("call_load_functions (total)");
 	call_load_functions();
+	load_timer.stop();
 
 	//------------ create game mode + make current --------------
 
 	Mode::set_current(std::make_shared< GameMode >(/*client*/));
 
+	//------------ frame capture ------------
+
+	std::unique_ptr< FrameCapture > frame_capture(new FrameCapture());
+	uint32_t frame_number = 0;
+	bool take_screenshot = false;
+
 	//------------ main loop ------------
 
 	//the window created above is resizable; this inline function will be
@@ -150,6 +209,11 @@ int main(int argc, char **argv) {
 				if (evt.type == SDL_WINDOWEVENT && evt.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
 					on_resize();
 				}
+				//F12 saves a screenshot (after this frame is drawn):
+				if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F12 && evt.key.repeat == 0) {
+					take_screenshot = true;
+					continue;
+				}
 				//handle input:
 				if (Mode::current && Mode::current->handle_event(evt, window_size)) {
 					// mode handled it; great
@@ -171,6 +235,9 @@ int main(int argc, char **argv) {
 			//lag to avoid spiral of death:
 			elapsed = std::min(0.1f, elapsed);
 
+			//captured sequences advance a fixed step per frame (so they play back at 60fps no matter how long saving takes):
+			if (!config.capture_directory.empty()) elapsed = 1.0f / 60.0f;
+
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
 		}
@@ -186,13 +253,44 @@ int main(int argc, char **argv) {
 			Mode::current->draw(drawable_size);
 		}
 
+		{ //(4) start reading back the frame, if it is being captured:
+			if (take_screenshot) {
+				char name[64];
+				std::snprintf(name, sizeof(name), "screenshots/screenshot-%llu-%u.png", (unsigned long long)std::time(nullptr), frame_number);
+				std::string filename = user_path(name);
+				frame_capture->capture(drawable_size, filename);
+				std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
+				take_screenshot = false;
+			}
+			if (!config.capture_directory.empty()) {
+				char name[32];
+				std::snprintf(name, sizeof(name), "/frame-%06u.png", frame_number);
+				frame_capture->capture(drawable_size, config.capture_directory + name);
+			}
+			frame_capture->update();
+			frame_number += 1;
+			if (config.capture_frames != 0 && frame_number >= config.capture_frames) {
+				Mode::set_current(nullptr);
+			}
+		}
+
 		//Finally, wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(window);
+
+		if (config.startup_report) {
+			//first frame is done, so report and quit:
+			record_startup_time("first frame swapped (since start)", ms_since_startup());
+			print_startup_report(std::cout);
+			Mode::set_current(nullptr);
+		}
 	}
 
 
 	//------------  teardown ------------
 
+	//(writes any captures that are still in flight)
+	frame_capture.reset();
+
 	SDL_GL_DeleteContext(context);
 	context = 0;
 
@@ -47,6 +47,9 @@ positions = b''
 normals = b''
 triangles = b''
 
+#adjacency (as uint, three per triangle) -- see WalkMesh.hpp for the encoding:
+adjacency = b''
+
 #strings contains the mesh names:
 strings = b''
 
@@ -108,6 +111,7 @@ for obj in bpy.data.objects:
 		return struct.pack('I', vertex_begin + vertex_inds[index])
 
 	#write the mesh triangles:
+	mesh_triangles = [] #(as lists of written vertex indices)
 	for poly in mesh.polygons:
 		assert(len(poly.loop_indices) == 3)
 
@@ -118,10 +122,29 @@ for obj in bpy.data.objects:
 		d = poly.normal.dot(out)
 		assert(d > 0.9)
 
+		tri = []
 		for i in range(0,3):
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
-			triangles += write_vertex(poly.vertices[i], mesh.loops[poly.loop_indices[i]].normal)
+			packed = write_vertex(poly.vertices[i], mesh.loops[poly.loop_indices[i]].normal)
+			triangles += packed
+			tri.append(struct.unpack('I', packed)[0])
+		mesh_triangles.append(tri)
 		triangle_count += 1
+
+	#write the adjacency (edge k of triangle t runs from tri[k] to tri[(k+1)%3]; its twin runs the other way):
+	edges = dict()
+	for t in range(0,len(mesh_triangles)):
+		for k in range(0,3):
+			edge = (mesh_triangles[t][k], mesh_triangles[t][(k+1)%3])
+			assert(edge not in edges) #each edge should only appear once in each direction
+			edges[edge] = (t, k)
+	for t in range(0,len(mesh_triangles)):
+		for k in range(0,3):
+			twin = (mesh_triangles[t][(k+1)%3], mesh_triangles[t][k])
+			if twin in edges:
+				adjacency += struct.pack('I', (edges[twin][0] << 2) | edges[twin][1])
+			else:
+				adjacency += struct.pack('I', 0xffffffff)
 	
 	#write (and possibly average) the normals:
 	for ns in vertex_normals:
@@ -171,6 +194,7 @@ write_chunk(b'n...', normals)
 write_chunk(b'tri0', triangles)
 write_chunk(b'str0', strings)
 write_chunk(b'idxA', index)
+write_chunk(b'adj0', adjacency)
 wrote = blob.tell()
 blob.close()
 
@@ -179,4 +203,5 @@ print("Wrote " + str(wrote) + " bytes [== " +
 	str(len(normals)+8) + " bytes of normals + " +
 	str(len(triangles)+8) + " bytes of triangles + " +
 	str(len(strings)+8) + " bytes of strings + " +
-	str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+	str(len(index)+8) + " bytes of index + " +
+	str(len(adjacency)+8) + " bytes of adjacency] to '" + outfile + "'")
@@ -0,0 +1,142 @@
+//pack builds a data archive (see Archive.hpp) from the files in a directory:
+//  ./pack dist dist/data.pack
+
+#include "Archive.hpp"
+#include "compress.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+//list all files under 'dir' (as paths relative to 'dir', using '/' as a separator):
+static void list_files(std::string const &dir, std::string const &prefix, std::vector< std::string > *files) {
+	#if defined(_WIN32)
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &found);
+	if (find == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to list directory '" + dir + "'.");
+	}
+	do {
+		std::string name = found.cFileName;
+		if (name.empty() || name[0] == '.') continue;
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			list_files(dir + "\\" + name, prefix + name + "/", files);
+		} else {
+			files->emplace_back(prefix + name);
+		}
+	} while (FindNextFileA(find, &found));
+	FindClose(find);
+	#else
+	DIR *d = opendir(dir.c_str());
+	if (!d) {
+		throw std::runtime_error("Failed to list directory '" + dir + "'.");
+	}
+	while (dirent *ent = readdir(d)) {
+		std::string name = ent->d_name;
+		if (name.empty() || name[0] == '.') continue;
+		struct stat st;
+		if (stat((dir + "/" + name).c_str(), &st) != 0) continue;
+		if (S_ISDIR(st.st_mode)) {
+			list_files(dir + "/" + name, prefix + name + "/", files);
+		} else if (S_ISREG(st.st_mode)) {
+			files->emplace_back(prefix + name);
+		}
+	}
+	closedir(d);
+	#endif
+}
+
+//things in 'dist' that aren't data:
+static bool should_skip(std::string const &name) {
+	auto ends_with = [&name](std::string const &suffix) {
+		return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	return name == "main" || ends_with(".exe") || ends_with(".dll") || ends_with(".pdb") || ends_with(".ilk") || ends_with(".pack");
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <directory> <archive.pack>" << std::endl;
+		return 1;
+	}
+	std::string dir = argv[1];
+	std::string out_filename = argv[2];
+
+	try {
+		std::vector< std::string > files;
+		list_files(dir, "", &files);
+		files.erase(std::remove_if(files.begin(), files.end(), should_skip), files.end());
+		std::sort(files.begin(), files.end());
+
+		std::vector< Archive::Entry > entries;
+		std::string names;
+		std::vector< char > payloads; //everything after the header
+
+		uint64_t total_size = 0;
+		for (auto const &name : files) {
+			std::ifstream in(dir + "/" + name, std::ios::binary);
+			if (!in) throw std::runtime_error("Failed to open '" + dir + "/" + name + "'.");
+			std::vector< char > data((std::istreambuf_iterator< char >(in)), std::istreambuf_iterator< char >());
+
+			Archive::Entry entry;
+			entry.hash = Archive::hash(name.data(), name.data() + name.size());
+			entry.name_begin = uint32_t(names.size());
+			names += name;
+			entry.name_end = uint32_t(names.size());
+			entry.size = data.size();
+
+			//only keep compressed version if it is worth decompressing:
+			std::vector< char > compressed;
+			compress(data.data(), data.size(), &compressed);
+			if (compressed.size() < data.size() - data.size() / 8) {
+				entry.codec = Archive::CodecLZ;
+				data.swap(compressed);
+			}
+			entry.stored_size = data.size();
+
+			while ((sizeof(Archive::Header) + payloads.size()) % Archive::PayloadAlignment != 0) payloads.emplace_back('\0');
+			entry.offset = sizeof(Archive::Header) + payloads.size();
+			payloads.insert(payloads.end(), data.begin(), data.end());
+
+			std::cout << "  " << name << " (" << entry.size << " bytes" << (entry.codec == Archive::CodecLZ ? ", compressed to " + std::to_string(entry.stored_size) : std::string()) << ")\n";
+			total_size += entry.stored_size;
+			entries.emplace_back(entry);
+		}
+
+		std::stable_sort(entries.begin(), entries.end(), [](Archive::Entry const &a, Archive::Entry const &b) {
+			return a.hash < b.hash;
+		});
+
+		Archive::Header header;
+		header.count = uint32_t(entries.size());
+		while ((sizeof(Archive::Header) + payloads.size()) % Archive::PayloadAlignment != 0) payloads.emplace_back('\0');
+		header.entries_offset = sizeof(Archive::Header) + payloads.size();
+		header.names_offset = header.entries_offset + entries.size() * sizeof(Archive::Entry);
+		header.names_size = names.size();
+
+		std::ofstream out(out_filename, std::ios::binary);
+		out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		out.write(payloads.data(), payloads.size());
+		out.write(reinterpret_cast< char const * >(entries.data()), entries.size() * sizeof(Archive::Entry));
+		out.write(names.data(), names.size());
+		if (!out) throw std::runtime_error("Failed to write '" + out_filename + "'.");
+
+		std::cout << "Wrote " << entries.size() << " files (" << total_size << " bytes of payload) to '" << out_filename << "'." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,160 @@
+//pngbench times PNG decoding (load_png) over a corpus of large images:
+//  ./pngbench
+//  ./pngbench --repeat 10 dist/textures/*.png
+// with no files, it encodes a few large generated images (with save_png) and decodes those;
+// files named on the command line are added to the corpus. Everything is decoded from memory,
+// so the times are decode only (no disk reads). Generated images are also checked to decode to what was encoded.
+
+#include "load_save_png.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+struct Entry {
+	std::string name;
+	std::string png; //encoded file contents
+	std::vector< glm::u8vec4 > expected; //(generated images only) what png should decode to
+};
+
+//photo-like: smooth color fields plus per-pixel noise, which deflate can't do much with:
+static std::vector< glm::u8vec4 > make_noisy(glm::uvec2 size, bool opaque, std::mt19937 &mt) {
+	std::vector< glm::u8vec4 > pixels(size.x * size.y);
+	std::uniform_int_distribution< int > noise(-12, 12);
+	for (uint32_t y = 0; y < size.y; ++y) {
+		for (uint32_t x = 0; x < size.x; ++x) {
+			float fx = x / float(size.x), fy = y / float(size.y);
+			glm::vec4 base(
+				0.5f + 0.4f * std::sin(9.0f * fx + 3.0f * fy),
+				0.5f + 0.4f * std::sin(7.0f * fy - 5.0f * fx),
+				0.5f + 0.4f * std::cos(11.0f * fx * fy),
+				opaque ? 1.0f : 0.75f + 0.25f * std::sin(13.0f * fx)
+			);
+			glm::u8vec4 &px = pixels[y * size.x + x];
+			for (uint32_t c = 0; c < 4; ++c) {
+				int v = int(base[c] * 255.0f) + (c < 3 || !opaque ? noise(mt) : 0);
+				px[c] = uint8_t(std::max(0, std::min(255, v)));
+			}
+		}
+	}
+	return pixels;
+}
+
+//ui/art-like: flat colored rectangles on a gradient, which compress well:
+static std::vector< glm::u8vec4 > make_flat(glm::uvec2 size, std::mt19937 &mt) {
+	std::vector< glm::u8vec4 > pixels(size.x * size.y);
+	for (uint32_t y = 0; y < size.y; ++y) {
+		for (uint32_t x = 0; x < size.x; ++x) {
+			pixels[y * size.x + x] = glm::u8vec4(uint8_t(x * 255 / size.x), uint8_t(y * 255 / size.y), 0x80, 0xff);
+		}
+	}
+	std::uniform_int_distribution< uint32_t > coord(0, std::min(size.x, size.y) - 1);
+	std::uniform_int_distribution< uint32_t > byte(0, 255);
+	for (uint32_t r = 0; r < 200; ++r) {
+		glm::uvec2 a(coord(mt), coord(mt));
+		glm::uvec2 b = glm::min(a + glm::uvec2(coord(mt) / 4, coord(mt) / 4), size);
+		glm::u8vec4 color(uint8_t(byte(mt)), uint8_t(byte(mt)), uint8_t(byte(mt)), uint8_t(byte(mt)));
+		for (uint32_t y = a.y; y < b.y; ++y) {
+			for (uint32_t x = a.x; x < b.x; ++x) {
+				pixels[y * size.x + x] = color;
+			}
+		}
+	}
+	return pixels;
+}
+
+int main(int argc, char **argv) {
+	uint32_t repeat = 5;
+	std::vector< std::string > files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 < argc && arg == "--repeat") repeat = uint32_t(std::atoi(argv[++i]));
+		else if (arg.size() > 0 && arg[0] == '-') {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--repeat n(5)] [file.png ...]" << std::endl;
+			return 1;
+		} else files.emplace_back(arg);
+	}
+	if (repeat == 0) repeat = 1;
+
+	std::vector< Entry > corpus;
+
+	//generated images:
+	std::mt19937 mt(0x9e9);
+	auto add_generated = [&corpus](std::string const &name, glm::uvec2 size, std::vector< glm::u8vec4 > &&pixels) {
+		Entry entry;
+		entry.name = name;
+		std::ostringstream png;
+		save_png(png, size.x, size.y, pixels.data(), LowerLeftOrigin);
+		entry.png = png.str();
+		entry.expected = std::move(pixels);
+		corpus.emplace_back(std::move(entry));
+	};
+	add_generated("noisy rgba 2048x2048", glm::uvec2(2048, 2048), make_noisy(glm::uvec2(2048, 2048), false, mt));
+	add_generated("noisy opaque 2048x2048", glm::uvec2(2048, 2048), make_noisy(glm::uvec2(2048, 2048), true, mt));
+	add_generated("flat 4096x2048", glm::uvec2(4096, 2048), make_flat(glm::uvec2(4096, 2048), mt));
+
+	//files from the command line:
+	for (auto const &file : files) {
+		std::ifstream in(file, std::ios::binary);
+		if (!in) {
+			std::cerr << "Failed to open '" << file << "'." << std::endl;
+			return 1;
+		}
+		Entry entry;
+		entry.name = file;
+		entry.png.assign(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+		corpus.emplace_back(std::move(entry));
+	}
+
+	std::cout << "Decoding " << corpus.size() << " images, " << repeat << " times each:" << std::endl;
+	std::cout << "  " << std::setw(36) << std::left << "image" << std::right
+		<< std::setw(10) << "png MB" << std::setw(12) << "ms/decode" << std::setw(14) << "pixel MB/s" << std::setw(12) << "png MB/s" << std::endl;
+
+	double total_ms = 0.0, total_pixel_mb = 0.0, total_png_mb = 0.0;
+	uint32_t mismatched = 0;
+	for (auto const &entry : corpus) {
+		glm::uvec2 size(0);
+		std::vector< glm::u8vec4 > pixels;
+		//(first decode is a warm-up, and is the one that gets checked)
+		if (!load_png(entry.png.data(), entry.png.size(), &size, &pixels, LowerLeftOrigin)) {
+			std::cerr << "Failed to decode '" << entry.name << "'." << std::endl;
+			return 1;
+		}
+		if (!entry.expected.empty() && pixels != entry.expected) {
+			std::cerr << "'" << entry.name << "' decoded to different pixels than were encoded." << std::endl;
+			mismatched += 1;
+		}
+
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t r = 0; r < repeat; ++r) {
+			load_png(entry.png.data(), entry.png.size(), &size, &pixels, LowerLeftOrigin);
+		}
+		double ms = std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - before).count() / repeat;
+
+		double pixel_mb = size.x * size.y * 4.0 / (1024.0 * 1024.0);
+		double png_mb = entry.png.size() / (1024.0 * 1024.0);
+		std::cout << "  " << std::setw(36) << std::left << entry.name << std::right << std::fixed
+			<< std::setprecision(2) << std::setw(10) << png_mb
+			<< std::setw(12) << ms
+			<< std::setprecision(1) << std::setw(14) << pixel_mb / (ms / 1000.0)
+			<< std::setw(12) << png_mb / (ms / 1000.0) << std::endl;
+		total_ms += ms;
+		total_pixel_mb += pixel_mb;
+		total_png_mb += png_mb;
+	}
+	std::cout << "  " << std::setw(36) << std::left << "total" << std::right << std::fixed
+		<< std::setprecision(2) << std::setw(10) << total_png_mb
+		<< std::setw(12) << total_ms
+		<< std::setprecision(1) << std::setw(14) << total_pixel_mb / (total_ms / 1000.0)
+		<< std::setw(12) << total_png_mb / (total_ms / 1000.0) << std::endl;
+
+	return (mismatched == 0 ? 0 : 1);
+}
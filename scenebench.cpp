@@ -0,0 +1,446 @@
+//scenebench times the CPU side of drawing (Scene::prepare) on a large generated scene:
+//  ./scenebench
+//  ./scenebench --objects 50000 --frames 100
+// prepare() doesn't touch OpenGL, so this needs no window or GL context.
+// it also checks that transforms moved since the last update_bvh() are drawn with their new matrices,
+// and reports how many draw calls batching (see Scene::DrawList) turns each pass into.
+// last, it checks Scene::cull, pick, and nearest against linear scans on a scene of --query-objects objects,
+// and reports the time per query for both; and that Scene::set_name() keeps the name indices up to date.
+
+#include "Scene.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+
+static float ms_since(std::chrono::high_resolution_clock::time_point const &before) {
+	return std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+}
+
+//--- spatial queries vs linear scans ---
+
+//the same box tests the queries use (so results should match exactly):
+static bool outside_frustum(glm::vec4 const (&planes)[6], glm::vec3 const &min, glm::vec3 const &max) {
+	for (auto const &plane : planes) {
+		glm::vec3 corner(
+			plane.x > 0.0f ? max.x : min.x,
+			plane.y > 0.0f ? max.y : min.y,
+			plane.z > 0.0f ? max.z : min.z
+		);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return true;
+	}
+	return false;
+}
+static float ray_box(glm::vec3 const &origin, glm::vec3 const &inv_direction, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 tmin = glm::min(t0, t1);
+	glm::vec3 tmax = glm::max(t0, t1);
+	float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+	float exit = std::min(std::min(tmax.x, tmax.y), tmax.z);
+	if (enter <= exit) return enter;
+	else return std::numeric_limits< float >::infinity();
+}
+static float point_box_dis2(glm::vec3 const &pt, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 d = glm::max(glm::max(min - pt, pt - max), glm::vec3(0.0f));
+	return glm::dot(d, d);
+}
+
+//build a scene of 'object_count' boxes scattered over a 1000 x 1000 x 50 region, and check cull(), pick(), and nearest()
+// against testing every object (on the first 'linear_queries' queries of each kind); returns false if any differ:
+static bool check_queries(uint32_t object_count, uint32_t queries, uint32_t linear_queries) {
+	Scene scene;
+	std::mt19937 mt(0x9e7);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	std::vector< Scene::Object * > objects;
+	for (uint32_t i = 0; i < object_count; ++i) {
+		Scene::Transform *transform = scene.new_transform();
+		transform->position = glm::vec3(1000.0f * unit(mt), 1000.0f * unit(mt), 50.0f * unit(mt));
+		transform->rotation = glm::angleAxis(unit(mt) * 6.2831853f, glm::normalize(glm::vec3(unit(mt), unit(mt), 1.0f)));
+		Scene::Object *object = scene.new_object(transform);
+		object->bbox_max = glm::vec3(0.5f) + 2.0f * glm::vec3(unit(mt), unit(mt), unit(mt));
+		object->bbox_min = -object->bbox_max;
+		objects.emplace_back(object);
+	}
+	scene.update_bvh();
+	linear_queries = std::min(linear_queries, queries);
+
+	std::cout << "Spatial queries on " << object_count << " objects (first " << linear_queries << " of each checked against a linear scan):" << std::endl;
+	auto report = [&](std::string const &what, uint32_t count, uint32_t different, double bvh_us, double linear_us) {
+		std::cout << "  " << std::setw(10) << std::left << what << std::right << std::setw(7) << count << " queries, "
+			<< different << " different;" << std::fixed << std::setprecision(2)
+			<< std::setw(10) << bvh_us << " us/query with the BVH," << std::setw(10) << linear_us << " us/query scanning" << std::endl;
+	};
+	auto us_since = [](std::chrono::high_resolution_clock::time_point const &before) {
+		return std::chrono::duration< double, std::micro >(std::chrono::high_resolution_clock::now() - before).count();
+	};
+	bool ok = true;
+
+	//cull: cameras at random spots a little above the boxes, looking down at random angles:
+	{
+		uint32_t cull_queries = std::max(1u, queries / 100); //(each visits many objects)
+		uint32_t cull_linear = std::min(cull_queries, std::max(1u, linear_queries / 100));
+		std::vector< glm::mat4 > world_to_clips;
+		for (uint32_t q = 0; q < cull_queries; ++q) {
+			glm::vec3 eye(1000.0f * unit(mt), 1000.0f * unit(mt), 60.0f + 40.0f * unit(mt));
+			glm::vec3 at(eye.x + 100.0f * (unit(mt) - 0.5f), eye.y + 100.0f * (unit(mt) - 0.5f), 0.0f);
+			world_to_clips.emplace_back(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f) * glm::lookAt(eye, at, glm::vec3(0.0f, 0.0f, 1.0f)));
+		}
+		std::vector< std::vector< Scene::Object * > > visible(cull_queries);
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t q = 0; q < cull_queries; ++q) scene.cull(world_to_clips[q], &visible[q]);
+		double bvh_us = us_since(before) / cull_queries;
+
+		std::vector< std::vector< Scene::Object * > > linear(cull_linear);
+		before = std::chrono::high_resolution_clock::now();
+		for (uint32_t q = 0; q < cull_linear; ++q) {
+			glm::mat4 const &m = world_to_clips[q];
+			glm::vec4 rows[4];
+			for (uint32_t r = 0; r < 4; ++r) rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+			glm::vec4 planes[6] = {
+				rows[3] + rows[0], rows[3] - rows[0],
+				rows[3] + rows[1], rows[3] - rows[1],
+				rows[3] + rows[2], rows[3] - rows[2],
+			};
+			for (Scene::Object *object : objects) {
+				if (!outside_frustum(planes, object->world_min, object->world_max)) linear[q].emplace_back(object);
+			}
+		}
+		double linear_us = us_since(before) / cull_linear;
+
+		uint32_t different = 0;
+		size_t total = 0;
+		for (uint32_t q = 0; q < cull_linear; ++q) {
+			std::sort(visible[q].begin(), visible[q].end());
+			std::sort(linear[q].begin(), linear[q].end());
+			if (visible[q] != linear[q]) different += 1;
+			total += linear[q].size();
+		}
+		report("cull()", cull_queries, different, bvh_us, linear_us);
+		std::cout << "    (" << total / cull_linear << " objects visible per view, on average)" << std::endl;
+		if (different != 0) ok = false;
+	}
+
+	//pick: rays from above the boxes, pointing down and across:
+	{
+		std::vector< glm::vec3 > origins, directions;
+		for (uint32_t q = 0; q < queries; ++q) {
+			origins.emplace_back(1000.0f * unit(mt), 1000.0f * unit(mt), 100.0f);
+			directions.emplace_back(glm::normalize(glm::vec3(unit(mt) - 0.5f, unit(mt) - 0.5f, -0.2f - unit(mt))));
+		}
+		std::vector< Scene::Object * > hits(queries);
+		std::vector< float > distances(queries, std::numeric_limits< float >::infinity());
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t q = 0; q < queries; ++q) hits[q] = scene.pick(origins[q], directions[q], &distances[q]);
+		double bvh_us = us_since(before) / queries;
+
+		uint32_t different = 0;
+		before = std::chrono::high_resolution_clock::now();
+		for (uint32_t q = 0; q < linear_queries; ++q) {
+			glm::vec3 inv_direction = 1.0f / directions[q];
+			float best = std::numeric_limits< float >::infinity();
+			for (Scene::Object *object : objects) {
+				best = std::min(best, ray_box(origins[q], inv_direction, object->world_min, object->world_max));
+			}
+			//(objects tied for closest are equally right, so compare distances)
+			if (hits[q] == nullptr ? best != std::numeric_limits< float >::infinity() : distances[q] != best) different += 1;
+		}
+		double linear_us = us_since(before) / linear_queries;
+		report("pick()", queries, different, bvh_us, linear_us);
+		if (different != 0) ok = false;
+	}
+
+	//nearest: points anywhere in (and a bit around) the region:
+	{
+		std::vector< glm::vec3 > points;
+		for (uint32_t q = 0; q < queries; ++q) {
+			points.emplace_back(1100.0f * unit(mt) - 50.0f, 1100.0f * unit(mt) - 50.0f, 150.0f * unit(mt) - 50.0f);
+		}
+		std::vector< float > distances(queries, -1.0f);
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t q = 0; q < queries; ++q) scene.nearest(points[q], &distances[q]);
+		double bvh_us = us_since(before) / queries;
+
+		uint32_t different = 0;
+		before = std::chrono::high_resolution_clock::now();
+		for (uint32_t q = 0; q < linear_queries; ++q) {
+			float best = std::numeric_limits< float >::infinity();
+			for (Scene::Object *object : objects) {
+				best = std::min(best, point_box_dis2(points[q], object->world_min, object->world_max));
+			}
+			if (distances[q] != std::sqrt(best)) different += 1;
+		}
+		double linear_us = us_since(before) / linear_queries;
+		report("nearest()", queries, different, bvh_us, linear_us);
+		if (different != 0) ok = false;
+	}
+
+	return ok;
+}
+
+//name transforms from strings that go away right after, rename them, and check that lookups follow:
+static bool check_names() {
+	Scene scene;
+	Scene::Transform *a = scene.new_transform();
+	Scene::Transform *b = scene.new_transform();
+	scene.set_name(a, std::string("Player") + "Camera");
+	scene.set_name(b, std::string("Sun"));
+	Scene::Camera *camera = scene.new_camera(a);
+	Scene::Lamp *lamp = scene.new_lamp(b);
+
+	uint32_t wrong = 0;
+	if (!(a->name == "PlayerCamera") || scene.lookup_transform("PlayerCamera") != a || scene.lookup_camera("PlayerCamera") != camera) wrong += 1;
+	if (scene.lookup_transform("Sun") != b || scene.lookup_lamp("Sun") != lamp) wrong += 1;
+
+	//renaming moves the transform (and what's attached to it) to the new name:
+	scene.set_name(a, std::string("Spectator"));
+	if (scene.lookup_transform("PlayerCamera") != nullptr || scene.lookup_camera("PlayerCamera") != nullptr) wrong += 1;
+	if (scene.lookup_transform("Spectator") != a || scene.lookup_camera("Spectator") != camera) wrong += 1;
+
+	//clearing the name takes it out of the indices:
+	scene.set_name(b, "");
+	if (scene.lookup_transform("Sun") != nullptr || scene.lookup_lamp("Sun") != nullptr || b->name.size() != 0) wrong += 1;
+
+	//deleting uses the current name:
+	scene.delete_camera(camera);
+	scene.delete_transform(a);
+	if (!scene.transform_index.empty() || !scene.camera_index.empty() || !scene.lamp_index.empty()) wrong += 1;
+
+	std::cout << "Scene::set_name(): " << wrong << " of 6 checks failed." << std::endl;
+	return wrong == 0;
+}
+
+int main(int argc, char **argv) {
+	uint32_t object_count = 20000;
+	uint32_t frames = 50;
+	uint32_t query_objects = 100000;
+	uint32_t queries = 10000;
+	uint32_t linear_queries = 500;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 < argc && arg == "--objects") object_count = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--frames") frames = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--query-objects") query_objects = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--queries") queries = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--linear-queries") linear_queries = uint32_t(std::atoi(argv[++i]));
+		else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--objects n(20000)] [--frames n(50)]"
+				" [--query-objects n(100000)] [--queries n(10000)] [--linear-queries n(500)]" << std::endl;
+			return 1;
+		}
+	}
+	if (object_count == 0 || frames == 0 || query_objects == 0 || queries == 0 || linear_queries == 0) {
+		std::cerr << "Need at least one object, frame, query object, query, and linear query." << std::endl;
+		return 1;
+	}
+
+	//programs set up like GameMode's (the numbers stand in for GL names, which prepare() only sorts by):
+	// default pass: batched texture program (with normals), or -- for every tenth object -- a per-object program with an itmv uniform
+	// shadow pass: batched depth program (without normals)
+	Scene::Object::ProgramInfo texture_info;
+	texture_info.program = 1;
+	texture_info.vao = 1;
+	texture_info.object_base_int = 0;
+	Scene::Object::ProgramInfo single_info;
+	single_info.program = 2;
+	single_info.vao = 2;
+	single_info.mvp_mat4 = 0;
+	single_info.mv_mat4x3 = 1;
+	single_info.itmv_mat3 = 2;
+	Scene::Object::ProgramInfo depth_info;
+	depth_info.program = 3;
+	depth_info.vao = 3;
+	depth_info.object_base_int = 0;
+	depth_info.object_data_normals = false;
+
+	//objects in groups of 16 under rotating parents, on a grid in the xy plane; some have non-uniform scales:
+	Scene scene;
+	std::mt19937 mt(0x5ce7e);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	uint32_t side = uint32_t(std::ceil(std::sqrt(float(object_count))));
+	std::vector< Scene::Transform * > parents;
+	for (uint32_t i = 0; i < object_count; ++i) {
+		if (i % 16 == 0) {
+			Scene::Transform *parent = scene.new_transform();
+			parent->position = glm::vec3(float(i % side), float(i / side), 0.0f);
+			parents.emplace_back(parent);
+		}
+		Scene::Transform *transform = scene.new_transform();
+		transform->set_parent(parents.back());
+		transform->position = glm::vec3(unit(mt), unit(mt), unit(mt)) * 4.0f;
+		transform->rotation = glm::angleAxis(unit(mt) * 6.2831853f, glm::normalize(glm::vec3(unit(mt), unit(mt), 1.0f)));
+		if (i % 5 == 0) transform->scale = glm::vec3(0.5f, 1.0f, 2.0f);
+		else transform->scale = glm::vec3(0.5f + unit(mt));
+
+		Scene::Object *object = scene.new_object(transform);
+		object->programs[Scene::Object::ProgramTypeDefault] = (i % 10 == 9 ? single_info : texture_info);
+		object->programs[Scene::Object::ProgramTypeDefault].textures[0] = 1 + (i % 4);
+		object->programs[Scene::Object::ProgramTypeDefault].start = 36 * (i % 7);
+		object->programs[Scene::Object::ProgramTypeDefault].count = 36;
+		object->programs[Scene::Object::ProgramTypeShadow] = depth_info;
+		object->programs[Scene::Object::ProgramTypeShadow].start = 36 * (i % 7);
+		object->programs[Scene::Object::ProgramTypeShadow].count = 36;
+		object->bbox_min = glm::vec3(-1.0f);
+		object->bbox_max = glm::vec3( 1.0f);
+	}
+
+	//camera and spot looking down at the whole grid:
+	float extent = float(side) + 8.0f;
+	Scene::Transform *camera_transform = scene.new_transform();
+	camera_transform->position = glm::vec3(0.5f * extent, 0.5f * extent, 1.5f * extent);
+	Scene::Camera *camera = scene.new_camera(camera_transform);
+	Scene::Transform *spot_transform = scene.new_transform();
+	spot_transform->position = glm::vec3(0.5f * extent, 0.5f * extent, 2.0f * extent);
+	Scene::Lamp *spot = scene.new_lamp(spot_transform);
+	spot->type = Scene::Lamp::Spot;
+	spot->fov = glm::radians(60.0f);
+	spot->clip_end = 4.0f * extent;
+	glm::mat4 camera_world_to_clip = camera->make_projection() * camera->transform->make_world_to_local();
+	glm::mat4 spot_world_to_clip = spot->make_projection() * spot->transform->make_world_to_local();
+
+	scene.update_bvh();
+
+	Scene::DrawList camera_list, shadow_list;
+
+	//--- check that transforms moved after update_bvh() are drawn where they are now ---
+	{
+		//move a few parents and every third object:
+		for (uint32_t i = 0; i < parents.size(); i += 7) {
+			parents[i]->position.z += 0.25f;
+		}
+		uint32_t index = 0;
+		for (Scene::Object *object = scene.first_object; object != nullptr; object = object->alloc_next, ++index) {
+			if (index % 3 == 0) object->transform->rotation = glm::normalize(object->transform->rotation * glm::angleAxis(0.5f, glm::vec3(1.0f, 0.0f, 0.0f)));
+		}
+
+		std::unordered_map< Scene::Object::ProgramInfo const *, Scene::Object const * > owner;
+		for (Scene::Object *object = scene.first_object; object != nullptr; object = object->alloc_next) {
+			owner[&object->programs[Scene::Object::ProgramTypeDefault]] = object;
+		}
+
+		scene.prepare(camera_world_to_clip, Scene::Object::ProgramTypeDefault, &camera_list);
+		uint32_t checked = 0, wrong = 0;
+		auto check = [&](Scene::Object const *object, glm::mat4 const &mv, glm::mat3 const &itmv) {
+			checked += 1;
+			glm::mat4 expected = object->transform->make_local_to_world();
+			bool ok = true;
+			for (uint32_t c = 0; c < 4; ++c) {
+				if (glm::vec3(mv[c]) != glm::vec3(expected[c])) ok = false;
+			}
+			//normal matrix times the transpose of the (upper 3x3 of the) world matrix should be the identity:
+			glm::mat3 product = itmv * glm::transpose(glm::mat3(expected));
+			for (uint32_t c = 0; c < 3; ++c) {
+				for (uint32_t r = 0; r < 3; ++r) {
+					if (std::abs(product[c][r] - (c == r ? 1.0f : 0.0f)) > 1e-4f) ok = false;
+				}
+			}
+			if (!ok) wrong += 1;
+		};
+		for (uint32_t i = 0; i < camera_list.batched.size(); ++i) {
+			glm::vec4 const *data = &camera_list.object_data[i * Scene::ObjectDataStride];
+			glm::mat4 mv(data[4], data[5], data[6], data[7]);
+			glm::mat3 itmv = glm::mat3(glm::vec3(data[8]), glm::vec3(data[9]), glm::vec3(data[10]));
+			check(owner[camera_list.batched[i]], mv, itmv);
+		}
+		for (auto const &single : camera_list.single) {
+			check(owner[single.info], glm::mat4(single.mv), single.itmv);
+		}
+		std::cout << "Moved transforms: " << checked << " drawn objects checked, " << wrong << " with wrong matrices." << std::endl;
+		if (wrong != 0) return 1;
+
+		scene.update_bvh();
+	}
+
+	//--- timing ---
+	std::cout << object_count << " objects, " << frames << " frames, both passes per frame:" << std::endl;
+	auto report = [&](std::string const &what, float ms) {
+		float per_frame = ms / frames;
+		std::cout << "  " << std::setw(44) << std::left << what << std::right
+		          << std::fixed << std::setprecision(3) << std::setw(8) << per_frame << " ms/frame  "
+		          << std::setprecision(0) << std::setw(8) << (2.0f * object_count) / per_frame << " objects/ms" << std::endl;
+	};
+
+	//what the draw loop did per object before Scene::prepare existed: world matrix, mvp, and an inverse for the normal matrix, in both passes:
+	{
+		float sink = 0.0f;
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; ++frame) {
+			for (glm::mat4 const &world_to_clip : { camera_world_to_clip, spot_world_to_clip }) {
+				for (Scene::Object *object = scene.first_object; object != nullptr; object = object->alloc_next) {
+					glm::mat4 mv = object->transform->make_local_to_world();
+					glm::mat4 mvp = world_to_clip * mv;
+					glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+					sink += mvp[3][3] + itmv[2][2];
+				}
+			}
+		}
+		report("per-object matrices (old draw loop)", ms_since(before));
+		if (sink == 12345.0f) std::cout << "(unlikely)" << std::endl; //(keeps the loop from being optimized away)
+	}
+
+	//prepare() with matrices cached by update_bvh():
+	{
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; ++frame) {
+			scene.prepare(camera_world_to_clip, Scene::Object::ProgramTypeDefault, &camera_list);
+			scene.prepare(spot_world_to_clip, Scene::Object::ProgramTypeShadow, &shadow_list);
+		}
+		report("prepare(), cached matrices", ms_since(before));
+	}
+
+	//prepare() after every transform has moved (so nothing cached is current):
+	{
+		for (Scene::Transform *parent : parents) {
+			parent->position.z += 1.0f;
+		}
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; ++frame) {
+			scene.prepare(camera_world_to_clip, Scene::Object::ProgramTypeDefault, &camera_list);
+			scene.prepare(spot_world_to_clip, Scene::Object::ProgramTypeShadow, &shadow_list);
+		}
+		report("prepare(), all transforms moved", ms_since(before));
+	}
+
+	//moving everything and calling update_bvh() every frame:
+	{
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; ++frame) {
+			for (Scene::Transform *parent : parents) {
+				parent->position.z += 0.01f;
+			}
+			scene.update_bvh();
+			scene.prepare(camera_world_to_clip, Scene::Object::ProgramTypeDefault, &camera_list);
+			scene.prepare(spot_world_to_clip, Scene::Object::ProgramTypeShadow, &shadow_list);
+		}
+		report("update_bvh() + prepare(), all moved", ms_since(before));
+	}
+
+	//draw calls submit() will make for each pass (one glMultiDrawArrays per run of batched objects with the same state
+	// when the driver has gl_DrawIDARB, otherwise one glDrawArrays per batched object; plus one per object that needs its own uniforms):
+	std::cout << "Draw calls per pass:" << std::endl;
+	auto draw_calls = [](std::string const &what, Scene::DrawList const &list) {
+		std::cout << "  " << std::setw(7) << std::left << what << std::right
+			<< std::setw(7) << list.batched.size() + list.single.size() << " objects, "
+			<< std::setw(5) << list.run_ends.size() + list.single.size() << " draw calls with gl_DrawIDARB ("
+			<< list.run_ends.size() << " batches + " << list.single.size() << " single), "
+			<< list.batched.size() + list.single.size() << " without" << std::endl;
+	};
+	draw_calls("camera", camera_list);
+	draw_calls("shadow", shadow_list);
+
+	if (!check_queries(query_objects, queries, linear_queries)) return 1;
+	if (!check_names()) return 1;
+
+	return 0;
+}
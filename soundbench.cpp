@@ -0,0 +1,211 @@
+//soundbench checks and times the mixer (Sound.cpp) without an audio device:
+//  ./soundbench
+//  ./soundbench --ops 500000 --blocks 2000
+// it drives the mixer with Sound::init_offline() / mix_offline() in place of the audio callback, and checks that
+// - mixing never allocates or frees memory, over a long run of random play/set/stop calls with every steal policy;
+// - StealQuietest takes the quietest voice, and doesn't take the same voice again before the sample it just started there is mixed;
+// - a voice fading out over a block is mixed with gains of start + step * index;
+// and it reports how long mixing a block takes with every voice playing (as voices mixed per ms).
+
+#include "Sound.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+//count allocations made while mixing:
+static bool in_mix = false;
+static uint64_t mix_allocations = 0;
+
+void *operator new(std::size_t size) {
+	if (in_mix) mix_allocations += 1;
+	void *ret = std::malloc(size ? size : 1);
+	if (!ret) throw std::bad_alloc();
+	return ret;
+}
+void operator delete(void *ptr) noexcept {
+	if (in_mix && ptr) mix_allocations += 1;
+	std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t) noexcept {
+	if (in_mix && ptr) mix_allocations += 1;
+	std::free(ptr);
+}
+
+static std::vector< float > mix_buffer(2 * Sound::MixSamples);
+static void mix() {
+	in_mix = true;
+	Sound::mix_offline(mix_buffer.data());
+	in_mix = false;
+}
+
+//mix until every voice has finished (stop_all_samples() fades out over less than one block):
+static void silence() {
+	Sound::stop_all_samples();
+	mix();
+	mix();
+}
+
+static Sound::Sample make_tone(uint32_t length, float frequency) {
+	std::vector< float > data(length);
+	for (uint32_t i = 0; i < length; ++i) {
+		data[i] = 0.5f * std::sin(i * frequency * (2.0f * 3.1415926f / Sound::AudioRate));
+	}
+	return Sound::Sample(data);
+}
+
+int main(int argc, char **argv) {
+	uint32_t ops = 100000;
+	uint32_t blocks = 400;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 < argc && arg == "--ops") ops = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--blocks") blocks = uint32_t(std::atoi(argv[++i]));
+		else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--ops n(100000)] [--blocks n(400)]" << std::endl;
+			return 1;
+		}
+	}
+	if (blocks == 0) blocks = 1;
+
+	Sound::init_offline();
+
+	Sound::Sample blip = make_tone(3001, 880.0f); //shorter than a block
+	Sound::Sample tone = make_tone(Sound::AudioRate, 220.0f);
+
+	uint32_t failures = 0;
+
+	//--- random calls, with a block mixed now and then ---
+	{
+		std::mt19937 mt(0x50d);
+		std::uniform_real_distribution< float > coord(-20.0f, 20.0f);
+		std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+		for (Sound::StealPolicy policy : { Sound::StealOldest, Sound::StealQuietest, Sound::StealNone }) {
+			Sound::set_steal_policy(policy);
+			mix_allocations = 0;
+			uint32_t mixed = 0;
+			std::vector< Sound::PlayingSample > playing;
+			for (uint32_t op = 0; op < ops; ++op) {
+				uint32_t what = mt() % 8;
+				if (what <= 1 || playing.empty()) {
+					Sound::Sample const &sample = (what == 0 ? blip : tone);
+					playing.emplace_back(sample.play(glm::vec3(coord(mt), coord(mt), 0.0f), unit(mt), (mt() % 4 == 0 ? Sound::Loop : Sound::Once)));
+					if (playing.size() > 2 * Sound::MaxVoices) playing.erase(playing.begin());
+				} else if (what == 2) {
+					playing[mt() % playing.size()].set_position(glm::vec3(coord(mt), coord(mt), 0.0f), 0.1f * unit(mt));
+				} else if (what == 3) {
+					playing[mt() % playing.size()].set_volume(unit(mt), 0.1f * unit(mt));
+				} else if (what == 4) {
+					playing[mt() % playing.size()].stop(0.1f * unit(mt));
+				} else if (what == 5) {
+					Sound::listener.set_position(glm::vec3(coord(mt), coord(mt), 0.0f), 0.1f * unit(mt));
+				} else if (what == 6) {
+					Sound::listener.set_right(glm::vec3(unit(mt) - 0.5f, unit(mt) - 0.5f, 0.0f), 0.1f * unit(mt));
+				} else {
+					Sound::set_volume(0.5f + unit(mt), 0.1f * unit(mt));
+				}
+				if (op % 20000 == 19999) Sound::stop_all_samples();
+				//mostly a block every few dozen calls, but sometimes enough calls in between to fill the command queue:
+				if (mt() % 40 == 0 && (op / 10000) % 4 != 3) {
+					mix();
+					mixed += 1;
+				}
+			}
+			std::cout << "Random calls (" << (policy == Sound::StealOldest ? "StealOldest" : policy == Sound::StealQuietest ? "StealQuietest" : "StealNone") << "): "
+				<< ops << " calls, " << mixed << " blocks mixed, " << mix_allocations << " allocations or frees while mixing." << std::endl;
+			if (mix_allocations != 0) failures += 1;
+			silence();
+		}
+	}
+
+	//--- StealQuietest ---
+	{
+		Sound::set_steal_policy(Sound::StealQuietest);
+		Sound::listener.set_position(glm::vec3(0.0f), 0.0f);
+		Sound::listener.set_right(glm::vec3(1.0f, 0.0f, 0.0f), 0.0f);
+		Sound::set_volume(1.0f, 0.0f);
+
+		//fill every voice, each farther away (so quieter) than the last:
+		std::vector< Sound::PlayingSample > playing;
+		for (uint32_t i = 0; i < Sound::MaxVoices; ++i) {
+			playing.emplace_back(tone.play(glm::vec3(0.0f, 2.0f + i, 0.0f), 1.0f, Sound::Loop));
+		}
+		mix();
+
+		//steal a quarter of the voices before mixing again: each should be the quietest voice not yet stolen,
+		// never one whose new (far-away, but not yet mixed) sample was just started:
+		uint32_t steals = Sound::MaxVoices / 4;
+		uint32_t wrong = 0;
+		std::vector< Sound::PlayingSample > stolen;
+		for (uint32_t s = 0; s < steals; ++s) {
+			stolen.emplace_back(blip.play(glm::vec3(0.0f, 1000.0f, 0.0f), 1.0f, Sound::Loop));
+			if (stolen.back().voice != playing[Sound::MaxVoices - 1 - s].voice) wrong += 1;
+		}
+		std::cout << "StealQuietest before mixing: " << steals << " samples started, " << wrong << " in other than the quietest voice left." << std::endl;
+		if (wrong != 0) failures += 1;
+
+		//once mixed, the new samples are the quietest ones, so they are the next to go:
+		mix();
+		Sound::PlayingSample next = blip.play(glm::vec3(0.0f), 1.0f, Sound::Once);
+		bool took_new = false;
+		for (auto const &s : stolen) {
+			if (s.voice == next.voice) took_new = true;
+		}
+		std::cout << "StealQuietest after mixing: " << (took_new ? "took" : "did not take") << " a voice from the quiet samples just started." << std::endl;
+		if (!took_new) failures += 1;
+
+		silence();
+		Sound::set_steal_policy(Sound::StealOldest);
+	}
+
+	//--- gain ramps ---
+	{
+		//one voice straight ahead at distance one (so both gains are cos(pi/4)), faded out by the master volume over exactly one block:
+		Sound::PlayingSample playing = tone.play(glm::vec3(0.0f, 1.0f, 0.0f), 1.0f, Sound::Loop);
+		Sound::set_volume(0.0f, float(Sound::MixSamples) / float(Sound::AudioRate));
+		mix();
+		float gain = std::cos(0.25f * 3.1415926f);
+		float worst = 0.0f;
+		for (uint32_t i = 0; i < Sound::MixSamples; ++i) {
+			float expected = tone.data[i] * (gain - gain * i / float(Sound::MixSamples));
+			worst = std::max(worst, std::max(std::abs(mix_buffer[2*i+0] - expected), std::abs(mix_buffer[2*i+1] - expected)));
+		}
+		std::cout << "Fade over one block: largest difference from start + step * index gains is " << worst << "." << std::endl;
+		if (worst > 1.5e-7f) failures += 1;
+		playing.stop(0.0f);
+		Sound::set_volume(1.0f, 0.0f);
+		silence();
+	}
+
+	//--- timing ---
+	{
+		//every voice looping a one-second sample, spread around the listener, with the listener moving (so every gain ramps):
+		std::vector< Sound::PlayingSample > playing;
+		for (uint32_t i = 0; i < Sound::MaxVoices; ++i) {
+			playing.emplace_back(tone.play(glm::vec3(float(i % 16) - 8.0f, float(i / 16) - 8.0f, 0.0f), 0.5f, Sound::Loop));
+		}
+		mix();
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t b = 0; b < blocks; ++b) {
+			Sound::listener.set_position(glm::vec3(std::sin(0.01f * b), 0.0f, 0.0f), 0.0f);
+			mix();
+		}
+		double ms = std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - before).count() / blocks;
+		std::cout << "Mixing " << Sound::MaxVoices << " voices: " << std::fixed << std::setprecision(3) << ms << " ms per " << Sound::MixSamples << "-sample block ("
+			<< std::setprecision(0) << Sound::MaxVoices / ms << " voices/ms; a block lasts " << std::setprecision(1) << 1000.0f * Sound::MixSamples / Sound::AudioRate << " ms)." << std::endl;
+		silence();
+	}
+
+	if (failures != 0) {
+		std::cout << failures << " check(s) failed." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+#include "startup_timing.hpp"
+
+#include <mutex>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+	struct Total {
+		float ms = 0.0f;
+		uint32_t count = 0;
+	};
+	std::mutex &get_mutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+	std::map< std::string, Total > &get_totals() {
+		static std::map< std::string, Total > totals;
+		return totals;
+	}
+	std::chrono::high_resolution_clock::time_point const startup_time = std::chrono::high_resolution_clock::now();
+}
+
+void record_startup_time(std::string const &name, float ms) {
+	std::unique_lock< std::mutex > lock(get_mutex());
+	Total &total = get_totals()[name];
+	total.ms += ms;
+	total.count += 1;
+}
+
+float ms_since_startup() {
+	return std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - startup_time).count();
+}
+
+void print_startup_report(std::ostream &out) {
+	std::vector< std::pair< std::string, Total > > sorted;
+	{
+		std::unique_lock< std::mutex > lock(get_mutex());
+		sorted.assign(get_totals().begin(), get_totals().end());
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](std::pair< std::string, Total > const &a, std::pair< std::string, Total > const &b) {
+		return a.second.ms > b.second.ms;
+	});
+
+	out << "Startup report (" << std::fixed << std::setprecision(2) << ms_since_startup() << " ms since start):\n";
+	out << std::setw(10) << "ms" << std::setw(7) << "count" << "  name\n";
+	for (auto const &entry : sorted) {
+		out << std::setw(10) << entry.second.ms << std::setw(7) << entry.second.count << "  " << entry.first << "\n";
+	}
+	out.flush();
+}
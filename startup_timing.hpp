@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <iostream>
+
+//startup_timing keeps track of where time goes while the program starts up:
+// (main.cpp's '--startup-report' flag prints the results after the first frame)
+//
+//  { StartupTimer timer("load_png " + filename);
+//    //...slow thing...
+//  }
+
+//add 'ms' milliseconds to the total for 'name' (safe to call from any thread):
+void record_startup_time(std::string const &name, float ms);
+
+//milliseconds since the program started (well, since static initialization):
+float ms_since_startup();
+
+//print totals for all names, longest first:
+void print_startup_report(std::ostream &out);
+
+//records the time between construction and destruction (or the call to stop()):
+struct StartupTimer {
+	StartupTimer(std::string const &name_) : name(name_), before(std::chrono::high_resolution_clock::now()) { }
+	~StartupTimer() { stop(); }
+	StartupTimer(StartupTimer const &) = delete;
+	StartupTimer &operator=(StartupTimer const &) = delete;
+
+	void stop() {
+		if (stopped) return;
+		stopped = true;
+		record_startup_time(name, std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count());
+	}
+
+	std::string name;
+	std::chrono::high_resolution_clock::time_point before;
+	bool stopped = false;
+};
@@ -3,8 +3,10 @@
 #include "compile_program.hpp"
 #include "gl_errors.hpp"
 
-TesseractProgram::TesseractProgram() {
-	program = compile_program(
+#include <memory>
+
+PendingProgram TesseractProgram::start_compile() {
+	return start_compile_program(
 		"#version 330\n"
 		"uniform mat4 object_to_clip;\n"
 		"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
@@ -22,12 +24,20 @@ TesseractProgram::TesseractProgram() {
 		"	fragColor = color;\n"
 		"}\n"
 	);
+}
+
+TesseractProgram::TesseractProgram(PendingProgram &pending) {
+	program = finish_compile_program(pending);
 
 	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
 
 	GL_ERRORS();
 }
 
-Load< TesseractProgram > tesseract_program(LoadTagInit, [](){
-	return new TesseractProgram();
+//(compiles at the same time as the other programs; see LoadFinishLater in Load.hpp)
+Load< TesseractProgram > tesseract_program(LoadTagInit, LoadFinishLater, [](){
+	auto pending = std::make_shared< PendingProgram >(TesseractProgram::start_compile());
+	return [pending](){
+		return new TesseractProgram(*pending);
+	};
 });
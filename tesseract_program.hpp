@@ -1,12 +1,15 @@
 #include "GL.hpp"
 #include "Load.hpp"
+#include "compile_program.hpp"
 
 struct TesseractProgram {
 	GLuint program = 0;
 
 	GLuint object_to_clip_mat4 = -1U;
 
-	TesseractProgram();
+	//compiled in two steps so all programs can compile at once (see start_compile_program()):
+	static PendingProgram start_compile();
+	TesseractProgram(PendingProgram &pending); //finishes compiling, looks up uniform locations
 };
 
 extern Load< TesseractProgram > tesseract_program;
\ No newline at end of file
@@ -0,0 +1,104 @@
+//texconv converts a PNG into a TextureFile (see TextureFile.hpp) with all mip levels precomputed:
+//  ./texconv dist/textures/wood.png dist/textures/wood.tex
+//  ./texconv --rgba8 dist/textures/wood.png dist/textures/wood.tex  (uncompressed)
+
+#include "TextureFile.hpp"
+#include "bc1.hpp"
+#include "load_save_png.hpp"
+#include "write_chunk.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+//halve an image (rounding down, but never below one pixel) by averaging 2x2 boxes:
+static void downsample(glm::uvec2 size, std::vector< glm::u8vec4 > const &from, glm::uvec2 *next_size, std::vector< glm::u8vec4 > *to) {
+	*next_size = glm::max(glm::uvec2(1), size / 2u);
+	to->assign(next_size->x * next_size->y, glm::u8vec4(0));
+	for (uint32_t y = 0; y < next_size->y; ++y) {
+		for (uint32_t x = 0; x < next_size->x; ++x) {
+			uint32_t x0 = std::min(2 * x, size.x - 1), x1 = std::min(2 * x + 1, size.x - 1);
+			uint32_t y0 = std::min(2 * y, size.y - 1), y1 = std::min(2 * y + 1, size.y - 1);
+			glm::uvec4 sum = glm::uvec4(from[y0 * size.x + x0]) + glm::uvec4(from[y0 * size.x + x1])
+			               + glm::uvec4(from[y1 * size.x + x0]) + glm::uvec4(from[y1 * size.x + x1]);
+			(*to)[y * next_size->x + x] = glm::u8vec4((sum + glm::uvec4(2)) / 4u);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	TextureFile::Format format = TextureFile::FormatBC1;
+	std::vector< std::string > files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--rgba8") format = TextureFile::FormatRGBA8;
+		else files.emplace_back(arg);
+	}
+	if (files.size() != 2) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--rgba8] <in.png> <out.tex>" << std::endl;
+		return 1;
+	}
+
+	try {
+		glm::uvec2 size;
+		std::vector< glm::u8vec4 > pixels;
+		load_png(files[0], &size, &pixels, LowerLeftOrigin);
+
+		if (format == TextureFile::FormatBC1) {
+			//BC1 has no alpha (well, one bit, which isn't used here):
+			for (auto const &px : pixels) {
+				if (px.a != 0xff) {
+					std::cerr << "WARNING: '" << files[0] << "' has transparent pixels; BC1 will make them opaque (use --rgba8 to keep them)." << std::endl;
+					break;
+				}
+			}
+		}
+
+		TextureFile::Header header;
+		header.format = format;
+		header.width = size.x;
+		header.height = size.y;
+
+		std::vector< TextureFile::Level > levels;
+		std::vector< uint8_t > data;
+		while (true) {
+			TextureFile::Level level;
+			level.width = size.x;
+			level.height = size.y;
+			level.offset = uint32_t(data.size());
+			if (format == TextureFile::FormatBC1) {
+				std::vector< uint8_t > blocks;
+				compress_bc1(size.x, size.y, pixels.data(), &blocks);
+				data.insert(data.end(), blocks.begin(), blocks.end());
+			} else {
+				uint8_t const *begin = reinterpret_cast< uint8_t const * >(pixels.data());
+				data.insert(data.end(), begin, begin + pixels.size() * 4);
+			}
+			level.size = uint32_t(data.size()) - level.offset;
+			levels.emplace_back(level);
+
+			if (size == glm::uvec2(1)) break;
+			glm::uvec2 next_size;
+			std::vector< glm::u8vec4 > next;
+			downsample(size, pixels, &next_size, &next);
+			size = next_size;
+			pixels.swap(next);
+		}
+		header.levels = uint32_t(levels.size());
+
+		std::ofstream out(files[1], std::ios::binary);
+		write_chunk(out, "tex0", &header, 1);
+		write_chunk(out, "levl", levels.data(), levels.size());
+		write_chunk(out, "data", data.data(), data.size());
+		if (!out) throw std::runtime_error("Failed to write '" + files[1] + "'.");
+
+		std::cout << "Wrote " << header.width << "x" << header.height << " (" << levels.size() << " levels, " << data.size() << " bytes) to '" << files[1] << "'." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
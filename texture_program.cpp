@@ -2,13 +2,14 @@
 
 #include "compile_program.hpp"
 #include "gl_errors.hpp"
+#include "Scene.hpp"
 
-TextureProgram::TextureProgram() {
-	program = compile_program(
+#include <memory>
+
+PendingProgram TextureProgram::start_compile() {
+	return start_compile_program(
 		"#version 330\n"
-		"uniform mat4 object_to_clip;\n"
-		"uniform mat4x3 object_to_light;\n"
-		"uniform mat3 normal_to_light;\n"
+		+ Scene::object_data_glsl() +
 		"uniform mat4 light_to_spot;\n"
 		"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
 		"in vec3 Normal;\n"
@@ -20,10 +21,10 @@ TextureProgram::TextureProgram() {
 		"out vec2 texCoord;\n"
 		"out vec4 spotPosition;\n"
 		"void main() {\n"
-		"	gl_Position = object_to_clip * Position;\n"
-		"	position = object_to_light * Position;\n"
+		"	gl_Position = object_to_clip_data() * Position;\n"
+		"	position = object_to_light_data() * Position;\n"
 		"	spotPosition = light_to_spot * vec4(position, 1.0);\n"
-		"	normal = normal_to_light * Normal;\n"
+		"	normal = normal_to_light_data() * Normal;\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
@@ -72,10 +73,12 @@ TextureProgram::TextureProgram() {
 		"	fragColor = texture(tex, texCoord) * vec4(color.rgb * total_light, color.a);\n"
 		"}\n"
 	);
+}
 
-	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
-	object_to_light_mat4x3 = glGetUniformLocation(program, "object_to_light");
-	normal_to_light_mat3 = glGetUniformLocation(program, "normal_to_light");
+TextureProgram::TextureProgram(PendingProgram &pending) {
+	program = finish_compile_program(pending);
+
+	object_base_int = glGetUniformLocation(program, "object_base");
 
 	sun_direction_vec3 = glGetUniformLocation(program, "sun_direction");
 	sun_color_vec3 = glGetUniformLocation(program, "sun_color");
@@ -97,11 +100,18 @@ TextureProgram::TextureProgram() {
 	GLuint spot_depth_tex_sampler2D = glGetUniformLocation(program, "spot_depth_tex");
 	glUniform1i(spot_depth_tex_sampler2D, 1);
 
+	GLuint object_data_samplerBuffer = glGetUniformLocation(program, "object_data");
+	glUniform1i(object_data_samplerBuffer, Scene::ObjectDataTextureUnit);
+
 	glUseProgram(0);
 
 	GL_ERRORS();
 }
 
-Load< TextureProgram > texture_program(LoadTagInit, [](){
-	return new TextureProgram();
+//(compiles at the same time as the other programs; see LoadFinishLater in Load.hpp)
+Load< TextureProgram > texture_program(LoadTagInit, LoadFinishLater, [](){
+	auto pending = std::make_shared< PendingProgram >(TextureProgram::start_compile());
+	return [pending](){
+		return new TextureProgram(*pending);
+	};
 });
@@ -1,5 +1,6 @@
 #include "GL.hpp"
 #include "Load.hpp"
+#include "compile_program.hpp"
 
 //TextureProgram draws a surface lit by two lights (a distant directional and a hemispherical light) where the surface color is drawn from texture unit 0:
 struct TextureProgram {
@@ -7,9 +8,7 @@ struct TextureProgram {
 	GLuint program = 0;
 
 	//uniform locations:
-	GLuint object_to_clip_mat4 = -1U;
-	GLuint object_to_light_mat4x3 = -1U;
-	GLuint normal_to_light_mat3 = -1U;
+	GLuint object_base_int = -1U; //per-object matrices are read from Scene's object data (see Scene::object_data_glsl())
 
 	GLuint sun_direction_vec3 = -1U; //direction *to* sun
 	GLuint sun_color_vec3 = -1U;
@@ -25,8 +24,11 @@ struct TextureProgram {
 	//textures:
 	//texture0 - texture for the surface
 	//texture1 - texture for spot light shadow map
+	//texture4 (Scene::ObjectDataTextureUnit) - per-object matrices
 
-	TextureProgram();
+	//compiled in two steps so all programs can compile at once (see start_compile_program()):
+	static PendingProgram start_compile();
+	TextureProgram(PendingProgram &pending); //finishes compiling, looks up uniform locations
 };
 
 extern Load< TextureProgram > texture_program;
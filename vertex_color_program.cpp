@@ -2,8 +2,10 @@
 
 #include "compile_program.hpp"
 
-VertexColorProgram::VertexColorProgram() {
-	program = compile_program(
+#include <memory>
+
+PendingProgram VertexColorProgram::start_compile() {
+	return start_compile_program(
 		"#version 330\n"
 		"uniform mat4 object_to_clip;\n"
 		"uniform mat4x3 object_to_light;\n"
@@ -46,6 +48,10 @@ VertexColorProgram::VertexColorProgram() {
 		"	fragColor = vec4(color.rgb * total_light, color.a);\n"
 		"}\n"
 	);
+}
+
+VertexColorProgram::VertexColorProgram(PendingProgram &pending) {
+	program = finish_compile_program(pending);
 
 	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
 	object_to_light_mat4x3 = glGetUniformLocation(program, "object_to_light");
@@ -57,6 +63,10 @@ VertexColorProgram::VertexColorProgram() {
 	sky_color_vec3 = glGetUniformLocation(program, "sky_color");
 }
 
-Load< VertexColorProgram > vertex_color_program(LoadTagInit, [](){
-	return new VertexColorProgram();
+//(compiles at the same time as the other programs; see LoadFinishLater in Load.hpp)
+Load< VertexColorProgram > vertex_color_program(LoadTagInit, LoadFinishLater, [](){
+	auto pending = std::make_shared< PendingProgram >(VertexColorProgram::start_compile());
+	return [pending](){
+		return new VertexColorProgram(*pending);
+	};
 });
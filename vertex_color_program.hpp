@@ -1,5 +1,6 @@
 #include "GL.hpp"
 #include "Load.hpp"
+#include "compile_program.hpp"
 
 struct VertexColorProgram {
 	//opengl program object:
@@ -14,7 +15,9 @@ struct VertexColorProgram {
 	GLuint sky_direction_vec3 = -1U;
 	GLuint sky_color_vec3 = -1U;
 
-	VertexColorProgram();
+	//compiled in two steps so all programs can compile at once (see start_compile_program()):
+	static PendingProgram start_compile();
+	VertexColorProgram(PendingProgram &pending); //finishes compiling, looks up uniform locations
 };
 
 extern Load< VertexColorProgram > vertex_color_program;
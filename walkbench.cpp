@@ -0,0 +1,461 @@
+//walkbench checks and times WalkMesh and WalkPathfinder on a generated mesh (the same kind walkgen writes):
+//  ./walkbench
+//  ./walkbench --size 200 --points 50000 --frames 20
+// it checks that:
+//  - start() finds the same points as start_brute_force() (on that mesh, and on one of at least 100k triangles)
+//  - the batched walk() gives exactly the same results as walking each point on its own
+//  - WalkPathfinder finds a path exactly when one exists, and the same path batched or not; that no path repeats a point;
+//    and that paths are straight lines in a convex region, and turn at exactly the right corners around a wall
+// and reports how fast each is; then it walks points around a few meshes made to be hard to walk on
+// (reporting the most edges a step ran into, and time per step). it exits non-zero if any check fails.
+// it needs no window, GL context, or data files.
+
+#include "WalkMesh.hpp"
+#include "WalkPathfinder.hpp"
+#include "grid_walkmesh.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <functional>
+
+static double seconds_since(std::chrono::high_resolution_clock::time_point const &before) {
+	return std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+}
+
+static bool same_point(WalkMesh::WalkPoint const &a, WalkMesh::WalkPoint const &b) {
+	return a.face == b.face && a.triangle == b.triangle && a.weights == b.weights;
+}
+
+//start() on random points around the mesh, checking the first 'brute_queries' against start_brute_force():
+// (returns false if any differ)
+static bool check_start(WalkMesh const &mesh, uint32_t queries, uint32_t brute_queries, std::mt19937 &mt) {
+	//query points go a little past the edges of the mesh, and above and below it:
+	glm::vec3 min(std::numeric_limits< float >::infinity()), max(-std::numeric_limits< float >::infinity());
+	for (auto const &tri : mesh.triangles) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			min = glm::min(min, mesh.vertices[tri[i]]);
+			max = glm::max(max, mesh.vertices[tri[i]]);
+		}
+	}
+	min -= glm::vec3(2.0f);
+	max += glm::vec3(2.0f);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+
+	brute_queries = std::min(brute_queries, queries);
+	std::vector< glm::vec3 > points;
+	points.reserve(queries);
+	for (uint32_t i = 0; i < queries; ++i) {
+		points.emplace_back(min + (max - min) * glm::vec3(unit(mt), unit(mt), unit(mt)));
+	}
+
+	std::vector< WalkMesh::WalkPoint > fast(queries), brute(brute_queries);
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < queries; ++i) fast[i] = mesh.start(points[i]);
+	double fast_s = seconds_since(before);
+
+	before = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < brute_queries; ++i) brute[i] = mesh.start_brute_force(points[i]);
+	double brute_s = seconds_since(before);
+
+	uint32_t different = 0;
+	for (uint32_t i = 0; i < brute_queries; ++i) {
+		if (!same_point(fast[i], brute[i])) different += 1;
+	}
+	std::cout << "  " << queries << " queries, " << different << " of the first " << brute_queries << " different from start_brute_force()." << std::endl;
+	std::cout << std::fixed << std::setprecision(1)
+		<< "  start()             " << std::setw(12) << queries / fast_s << " queries/s" << std::setw(10) << 1e6 * fast_s / queries << " us/query" << std::endl;
+	if (brute_queries != 0) {
+		std::cout << "  start_brute_force() " << std::setw(12) << brute_queries / brute_s << " queries/s" << std::setw(10) << 1e6 * brute_s / brute_queries << " us/query" << std::endl;
+	}
+	return different == 0;
+}
+
+//points walked on each stress test mesh:
+constexpr uint32_t StressPoints = 200;
+
+//walk points at random over a mesh made to be hard to walk on, for 'steps' steps each:
+// (steps are 0.3 units long, with every seventh one 5 units long, in random directions)
+// reports the most edges any one step ran into and the average time per step;
+// returns false if a step ended somewhere that isn't a valid barycentric point or ran out of crossings.
+static bool stress_walk(std::string const &name, std::vector< glm::vec3 > const &vertices, std::vector< glm::uvec3 > const &triangles, uint32_t steps, std::mt19937 &mt) {
+	std::vector< glm::vec3 > normals(vertices.size(), glm::vec3(0.0f, 0.0f, 1.0f));
+	WalkMesh mesh(vertices, normals, triangles);
+
+	glm::vec3 min(std::numeric_limits< float >::infinity()), max(-std::numeric_limits< float >::infinity());
+	for (auto const &v : vertices) {
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	auto signed_unit = [&]() { return 2.0f * unit(mt) - 1.0f; };
+
+	//steps are made ahead of time so only walking is timed:
+	std::vector< WalkMesh::WalkPoint > points;
+	for (uint32_t p = 0; p < StressPoints; ++p) {
+		points.emplace_back(mesh.start(min + (max - min) * glm::vec3(unit(mt), unit(mt), unit(mt))));
+	}
+	std::vector< glm::vec3 > step_list(steps);
+	for (uint32_t s = 0; s < steps; ++s) {
+		float length = (s % 7 == 6 ? 5.0f : 0.3f);
+		step_list[s] = glm::vec3(signed_unit(), signed_unit(), 0.1f * signed_unit()) * length;
+	}
+
+	uint32_t worst = 0;
+	uint32_t bad = 0;
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t p = 0; p < StressPoints; ++p) {
+		WalkMesh::WalkPoint &wp = points[p];
+		for (uint32_t s = 0; s < steps; ++s) {
+			//(each point starts at a different place in the list, so they don't all take the same steps)
+			uint32_t crossings = mesh.walk(wp, step_list[(s + 7 * p) % steps]);
+			worst = std::max(worst, crossings);
+			glm::vec3 const &w = wp.weights;
+			if (!(w.x >= 0.0f && w.y >= 0.0f && w.z >= 0.0f && std::abs(w.x + w.y + w.z - 1.0f) < 1e-5f)) bad += 1;
+		}
+	}
+	double seconds = seconds_since(before);
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+		<< std::setw(7) << triangles.size() << " triangles"
+		<< std::setw(6) << worst << " most crossings in a step"
+		<< std::fixed << std::setprecision(3) << std::setw(9) << 1e6 * seconds / (double(StressPoints) * steps) << " us/step";
+	if (bad != 0) std::cout << "  (" << bad << " invalid points)";
+	std::cout << std::endl;
+	return bad == 0 && worst < WalkMesh::MaxWalkCrossings;
+}
+
+int main(int argc, char **argv) {
+	uint32_t size = 64; //grid cells on a side (as for walkgen)
+	float holes = 0.02f;
+	float bumps = 0.25f;
+	uint32_t seed = 0;
+	uint32_t queries = 20000; //start() queries
+	uint32_t brute_queries = 200; //how many of those are checked against start_brute_force() (which is much slower)
+	uint32_t point_count = 20000; //points walked
+	uint32_t frames = 50; //steps per point
+	uint32_t paths = 500; //pathfinding queries
+	uint32_t stress_steps = 2000; //steps per point in the stress test
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 < argc && arg == "--size") size = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--holes") holes = float(std::atof(argv[++i]));
+		else if (i + 1 < argc && arg == "--bumps") bumps = float(std::atof(argv[++i]));
+		else if (i + 1 < argc && arg == "--seed") seed = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--queries") queries = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--brute-queries") brute_queries = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--points") point_count = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--frames") frames = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--paths") paths = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--stress-steps") stress_steps = uint32_t(std::atoi(argv[++i]));
+		else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--size cells(64)] [--holes fraction(0.02)] [--bumps height(0.25)] [--seed n(0)]"
+				" [--queries n(20000)] [--brute-queries n(200)] [--points n(20000)] [--frames n(50)] [--paths n(500)] [--stress-steps n(2000)]" << std::endl;
+			return 1;
+		}
+	}
+	if (size == 0 || size > 4096 || queries == 0 || point_count == 0 || frames == 0 || paths == 0 || stress_steps == 0) {
+		std::cerr << "Need a mesh size in [1,4096], and at least one query, point, frame, path, and stress step." << std::endl;
+		return 1;
+	}
+
+	std::vector< glm::vec3 > vertices;
+	std::vector< glm::vec3 > normals;
+	std::vector< glm::uvec3 > triangles;
+	make_grid_walkmesh(size, holes, bumps, seed, &vertices, &normals, &triangles);
+	if (triangles.empty()) {
+		std::cerr << "Generated mesh has no triangles (too many holes?)." << std::endl;
+		return 1;
+	}
+	WalkMesh mesh(vertices, normals, triangles);
+	std::cout << "Mesh: " << size << "x" << size << " cells, " << triangles.size() << " triangles." << std::endl;
+
+	std::mt19937 mt(0xba7c4);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	auto random_point = [&]() {
+		//(a little past the edges of the grid, and above and below it)
+		return glm::vec3(
+			unit(mt) * (size + 4.0f) - 2.0f,
+			unit(mt) * (size + 4.0f) - 2.0f,
+			unit(mt) * 4.0f - 2.0f
+		);
+	};
+
+	uint32_t failures = 0;
+
+	//--- start() vs start_brute_force() ---
+	std::cout << "start() on the generated mesh:" << std::endl;
+	if (!check_start(mesh, queries, brute_queries, mt)) failures += 1;
+
+	//(again on a mesh of at least 100k triangles, unless the generated mesh is already that big)
+	if (triangles.size() < 100000) {
+		uint32_t big_size = uint32_t(std::ceil(std::sqrt(100000.0f / (2.0f * (1.0f - std::min(holes, 0.5f))))));
+		std::vector< glm::vec3 > big_vertices;
+		std::vector< glm::vec3 > big_normals;
+		std::vector< glm::uvec3 > big_triangles;
+		do {
+			make_grid_walkmesh(big_size, holes, bumps, seed, &big_vertices, &big_normals, &big_triangles);
+			big_size += 1;
+		} while (big_triangles.size() < 100000);
+		WalkMesh big(big_vertices, big_normals, big_triangles);
+		std::cout << "start() on a " << big_size - 1 << "x" << big_size - 1 << " mesh (" << big_triangles.size() << " triangles):" << std::endl;
+		if (!check_start(big, queries, brute_queries, mt)) failures += 1;
+	}
+
+	//--- batched walk() vs single-point walk() ---
+	{
+		WalkMesh::WalkPoints batched;
+		for (uint32_t i = 0; i < point_count; ++i) batched.push_back(mesh.start(random_point()));
+		WalkMesh::WalkPoints single = batched;
+
+		//each point wanders: its heading turns a bit every frame, and its speed varies:
+		std::vector< float > headings(point_count);
+		for (auto &h : headings) h = unit(mt) * 6.2831853f;
+		std::vector< std::vector< glm::vec3 > > steps(frames, std::vector< glm::vec3 >(point_count));
+		for (auto &frame : steps) {
+			for (uint32_t i = 0; i < point_count; ++i) {
+				headings[i] += (unit(mt) - 0.5f) * 0.5f;
+				float length = 0.05f + 0.45f * unit(mt);
+				frame[i] = glm::vec3(std::cos(headings[i]) * length, std::sin(headings[i]) * length, 0.0f);
+			}
+		}
+
+		auto before = std::chrono::high_resolution_clock::now();
+		for (auto const &frame : steps) {
+			for (uint32_t i = 0; i < point_count; ++i) {
+				WalkMesh::WalkPoint wp = single.get(i);
+				mesh.walk(wp, frame[i]);
+				single.set(i, wp);
+			}
+		}
+		double single_s = seconds_since(before);
+
+		before = std::chrono::high_resolution_clock::now();
+		for (auto const &frame : steps) {
+			mesh.walk(batched, frame);
+		}
+		double batched_s = seconds_since(before);
+
+		uint32_t different = 0;
+		for (uint32_t i = 0; i < point_count; ++i) {
+			if (!same_point(single.get(i), batched.get(i))) different += 1;
+		}
+		double total = double(point_count) * frames;
+		std::cout << "walk(): " << point_count << " points, " << frames << " frames, " << different << " points different between batched and single-point walks." << std::endl;
+		std::cout << std::fixed << std::setprecision(0)
+			<< "  single-point walk() " << std::setw(12) << total / single_s << " steps/s" << std::endl
+			<< "  batched walk()      " << std::setw(12) << total / batched_s << " steps/s" << std::endl;
+		if (different != 0) failures += 1;
+	}
+
+	//--- pathfinding ---
+	{
+		//connected pieces of the mesh (through WalkMesh::adjacency), to know which queries have a path:
+		std::vector< uint32_t > piece(mesh.triangles.size(), -1U);
+		uint32_t pieces = 0;
+		std::vector< uint32_t > todo;
+		for (uint32_t seed_face = 0; seed_face < piece.size(); ++seed_face) {
+			if (piece[seed_face] != -1U) continue;
+			piece[seed_face] = pieces;
+			todo.emplace_back(seed_face);
+			while (!todo.empty()) {
+				uint32_t face = todo.back();
+				todo.pop_back();
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t across = mesh.adjacency[3 * face + k];
+					if (across == -1U || piece[across >> 2] != -1U) continue;
+					piece[across >> 2] = pieces;
+					todo.emplace_back(across >> 2);
+				}
+			}
+			pieces += 1;
+		}
+
+		WalkPathfinder pathfinder(mesh);
+		std::vector< WalkPathfinder::Query > batch(paths);
+		for (auto &query : batch) {
+			query.from = mesh.start(random_point());
+			query.to = mesh.start(random_point());
+		}
+
+		//one at a time (as game code calling find_path() would):
+		std::vector< std::vector< glm::vec3 > > single_paths(paths);
+		std::vector< float > latencies(paths);
+		uint32_t wrong = 0;
+		for (uint32_t i = 0; i < paths; ++i) {
+			auto before = std::chrono::high_resolution_clock::now();
+			bool found = pathfinder.find_path(batch[i].from, batch[i].to, &single_paths[i]);
+			latencies[i] = float(1000.0 * seconds_since(before));
+			if (found != (piece[batch[i].from.face] == piece[batch[i].to.face])) wrong += 1;
+		}
+
+		//all at once:
+		auto before = std::chrono::high_resolution_clock::now();
+		pathfinder.find_paths(batch);
+		double batch_s = seconds_since(before);
+
+		uint32_t different = 0;
+		uint32_t repeats = 0; //paths with the same point twice in a row
+		for (uint32_t i = 0; i < paths; ++i) {
+			if (batch[i].found != !single_paths[i].empty() || batch[i].path != single_paths[i]) different += 1;
+			for (uint32_t p = 1; p < single_paths[i].size(); ++p) {
+				if (single_paths[i][p] == single_paths[i][p-1]) {
+					repeats += 1;
+					break;
+				}
+			}
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+		float total_ms = 0.0f;
+		for (float ms : latencies) total_ms += ms;
+		std::cout << "find_path(): " << paths << " queries over " << pieces << " connected pieces, " << wrong << " wrong about whether a path exists, "
+			<< different << " different between find_paths() and find_path(), " << repeats << " with a point repeated." << std::endl;
+		std::cout << std::fixed << std::setprecision(3)
+			<< "  find_path() latency  " << total_ms / paths << " ms average, "
+			<< latencies[std::min(paths - 1, paths * 99 / 100)] << " ms p99, "
+			<< latencies.back() << " ms max" << std::endl
+			<< std::setprecision(0)
+			<< "  find_paths()        " << std::setw(12) << paths / batch_s << " queries/s" << std::endl;
+		if (wrong != 0 || different != 0 || repeats != 0) failures += 1;
+
+		//flat n x n grid of unit cells, leaving out cells for which 'solid(x,y)' is true:
+		auto flat_grid = [](uint32_t n, std::function< bool(uint32_t, uint32_t) > const &solid) {
+			std::vector< glm::vec3 > grid_vertices;
+			std::vector< glm::uvec3 > grid_triangles;
+			for (uint32_t y = 0; y <= n; ++y) {
+				for (uint32_t x = 0; x <= n; ++x) {
+					grid_vertices.emplace_back(float(x), float(y), 0.0f);
+				}
+			}
+			for (uint32_t y = 0; y < n; ++y) {
+				for (uint32_t x = 0; x < n; ++x) {
+					if (solid(x, y)) continue;
+					uint32_t a = y * (n + 1) + x, b = a + 1, c = a + (n + 1), d = c + 1;
+					grid_triangles.emplace_back(a, b, d);
+					grid_triangles.emplace_back(a, d, c);
+				}
+			}
+			std::vector< glm::vec3 > grid_normals(grid_vertices.size(), glm::vec3(0.0f, 0.0f, 1.0f));
+			return WalkMesh(grid_vertices, grid_normals, grid_triangles);
+		};
+
+		//in a convex region, every path is a straight line:
+		{
+			WalkMesh square = flat_grid(8, [](uint32_t, uint32_t) { return false; });
+			WalkPathfinder square_pathfinder(square);
+			std::uniform_real_distribution< float > coord(0.0f, 8.0f);
+			uint32_t bent = 0;
+			std::vector< glm::vec3 > path;
+			for (uint32_t i = 0; i < paths; ++i) {
+				WalkMesh::WalkPoint from = square.start(glm::vec3(coord(mt), coord(mt), 0.0f));
+				WalkMesh::WalkPoint to = square.start(glm::vec3(coord(mt), coord(mt), 0.0f));
+				square_pathfinder.find_path(from, to, &path);
+				std::vector< glm::vec3 > expected{ square.world_point(from), square.world_point(to) };
+				if (expected[0] == expected[1]) expected.pop_back();
+				if (path != expected) bent += 1;
+			}
+			std::cout << "  convex 8x8 square: " << paths << " queries, " << bent << " not a straight line from start to end." << std::endl;
+			if (bent != 0) failures += 1;
+		}
+
+		//around a wall (3x3 grid without the cells at x = 1, y >= 1), a path turns at the wall's two corners, once each:
+		{
+			WalkMesh wall = flat_grid(3, [](uint32_t x, uint32_t y) { return x == 1 && y >= 1; });
+			WalkPathfinder wall_pathfinder(wall);
+			std::vector< glm::vec3 > path;
+			wall_pathfinder.find_path(wall.start(glm::vec3(0.5f, 2.5f, 0.0f)), wall.start(glm::vec3(2.5f, 2.5f, 0.0f)), &path);
+			std::vector< glm::vec3 > expected{ glm::vec3(0.5f, 2.5f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(2.0f, 1.0f, 0.0f), glm::vec3(2.5f, 2.5f, 0.0f) };
+			bool close = (path.size() == expected.size());
+			for (uint32_t p = 0; close && p < path.size(); ++p) {
+				if (glm::length(path[p] - expected[p]) > 1e-5f) close = false;
+			}
+			std::cout << "  around a wall: " << path.size() << " points (" << (close ? "as expected" : "expected 4: start, (1,1), (2,1), end") << ")." << std::endl;
+			if (!close) failures += 1;
+		}
+	}
+
+	//--- walking on meshes made to be hard to walk on ---
+	{
+		std::cout << "walk() stress test (" << StressPoints << " points x " << stress_steps << " steps each):" << std::endl;
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+		std::vector< glm::vec3 > vertices;
+		std::vector< glm::uvec3 > triangles;
+
+		//a bumpy grid with a regular pattern of holes (lots of solid edges and corners):
+		{
+			uint32_t n = 60;
+			for (uint32_t y = 0; y <= n; ++y) {
+				for (uint32_t x = 0; x <= n; ++x) {
+					vertices.emplace_back(float(x), float(y), 0.3f * unit(mt));
+				}
+			}
+			for (uint32_t y = 0; y < n; ++y) {
+				for (uint32_t x = 0; x < n; ++x) {
+					if ((x * 7 + y * 13) % 5 == 0) continue;
+					uint32_t a = y * (n + 1) + x, b = a + 1, c = a + (n + 1), d = c + 1;
+					triangles.emplace_back(a, b, d);
+					triangles.emplace_back(a, d, c);
+				}
+			}
+			if (!stress_walk("grid with holes", vertices, triangles, stress_steps, mt)) failures += 1;
+		}
+
+		//a fan of 720 slivers around one vertex (a step through the middle crosses half of them):
+		{
+			vertices.clear();
+			triangles.clear();
+			uint32_t k = 720;
+			vertices.emplace_back(0.0f, 0.0f, 0.0f);
+			for (uint32_t i = 0; i < k; ++i) {
+				float a = 6.2831853f * i / k;
+				vertices.emplace_back(10.0f * std::cos(a), 10.0f * std::sin(a), 0.5f * std::sin(3.0f * a));
+			}
+			for (uint32_t i = 0; i < k; ++i) {
+				triangles.emplace_back(0, 1 + i, 1 + (i + 1) % k);
+			}
+			if (!stress_walk("720-sliver fan", vertices, triangles, stress_steps, mt)) failures += 1;
+		}
+
+		//needle-thin triangles, each on its own (every edge is solid, and the corners are very sharp):
+		{
+			vertices.clear();
+			triangles.clear();
+			for (uint32_t i = 0; i < 200; ++i) {
+				uint32_t b = uint32_t(vertices.size());
+				float x = i * 3.0f;
+				vertices.emplace_back(x, 0.0f, 0.0f);
+				vertices.emplace_back(x + 2.0f, 0.001f, 0.0f);
+				vertices.emplace_back(x + 2.0f, -0.001f, 0.0f);
+				triangles.emplace_back(b, b + 2, b + 1);
+			}
+			if (!stress_walk("isolated needles", vertices, triangles, stress_steps, mt)) failures += 1;
+		}
+
+		//a narrow corridor with sawtooth walls (steps keep sliding into corners):
+		{
+			vertices.clear();
+			triangles.clear();
+			uint32_t n = 400;
+			for (uint32_t i = 0; i <= n; ++i) {
+				vertices.emplace_back(i * 0.1f, (i % 2 ? 0.05f : 0.0f), 0.0f);
+				vertices.emplace_back(i * 0.1f, (i % 2 ? 0.06f : 0.11f), 0.01f * unit(mt));
+			}
+			for (uint32_t i = 0; i < n; ++i) {
+				uint32_t a = 2 * i, b = a + 2, c = a + 1, d = a + 3;
+				triangles.emplace_back(a, b, d);
+				triangles.emplace_back(a, d, c);
+			}
+			if (!stress_walk("sawtooth corridor", vertices, triangles, stress_steps, mt)) failures += 1;
+		}
+	}
+
+	return (failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,72 @@
+//walkgen writes a procedurally generated walkmesh file (same format as meshes/export-walkmeshes.py writes):
+//  ./walkgen dist/grid.w
+//  ./walkgen --size 200 --holes 0.05 --bumps 0.5 --seed 3 --name level dist/level.w
+// the mesh is a square grid of unit cells, with smooth hills and randomly removed cells, which makes
+// a quick stand-in for an exported level (or a big mesh for trying out walking and pathfinding).
+
+#include "WalkMesh.hpp"
+#include "grid_walkmesh.hpp"
+#include "write_chunk.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <stdexcept>
+
+int main(int argc, char **argv) {
+	uint32_t size = 64; //cells on a side
+	float holes = 0.02f; //fraction of cells removed
+	float bumps = 0.25f; //height of hills
+	uint32_t seed = 0;
+	std::string name = "grid";
+	std::vector< std::string > files;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 < argc && arg == "--size") size = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--holes") holes = float(std::atof(argv[++i]));
+		else if (i + 1 < argc && arg == "--bumps") bumps = float(std::atof(argv[++i]));
+		else if (i + 1 < argc && arg == "--seed") seed = uint32_t(std::atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--name") name = argv[++i];
+		else files.emplace_back(arg);
+	}
+	if (files.size() != 1 || size == 0 || size > 4096) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--size cells(64)] [--holes fraction(0.02)] [--bumps height(0.25)] [--seed n(0)] [--name mesh-name(grid)] <out.w>" << std::endl;
+		return 1;
+	}
+
+	try {
+		std::vector< glm::vec3 > vertices;
+		std::vector< glm::vec3 > normals;
+		std::vector< glm::uvec3 > triangles;
+		make_grid_walkmesh(size, holes, bumps, seed, &vertices, &normals, &triangles);
+
+		std::vector< uint32_t > adjacency(3 * triangles.size());
+		WalkMesh::compute_adjacency(ChunkFile::Span< glm::uvec3 >(triangles.data(), triangles.data() + triangles.size()), adjacency.data());
+
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+			uint32_t triangle_begin, triangle_end;
+		};
+		IndexEntry entry{0, uint32_t(name.size()), 0, uint32_t(vertices.size()), 0, uint32_t(triangles.size())};
+
+		std::ofstream out(files[0], std::ios::binary);
+		if (!out) throw std::runtime_error("Failed to open '" + files[0] + "' for writing.");
+		write_chunk(out, "p...", vertices.data(), vertices.size());
+		write_chunk(out, "n...", normals.data(), normals.size());
+		write_chunk(out, "tri0", triangles.data(), triangles.size());
+		write_chunk(out, "str0", name.data(), name.size());
+		write_chunk(out, "idxA", &entry, 1);
+		write_chunk(out, "adj0", adjacency.data(), adjacency.size());
+		if (!out) throw std::runtime_error("Failed to write '" + files[0] + "'.");
+
+		std::cout << "Wrote '" << name << "' (" << vertices.size() << " vertices, " << triangles.size() << " triangles) to '" << files[0] << "'." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
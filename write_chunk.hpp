@@ -0,0 +1,17 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cassert>
+
+//write 'count' structures as a chunk that read_chunk (read_chunk.hpp) can read back:
+// (4-byte magic, 32-bit size in bytes, then the data)
+template< typename T >
+void write_chunk(std::ostream &to, std::string const &magic, T const *data, size_t count) {
+	assert(magic.size() == 4);
+	uint32_t size = uint32_t(count * sizeof(T));
+	to.write(magic.data(), 4);
+	to.write(reinterpret_cast< char const * >(&size), 4);
+	to.write(reinterpret_cast< char const * >(data), size);
+}